@@ -0,0 +1,296 @@
+#ifndef BlackHole_aipilots_h
+#define BlackHole_aipilots_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "kinematics.h"
+
+// Time spent by the AI in the last tick, in seconds.
+struct AITimes {
+    double think{0.0};
+    double act{0.0};
+
+    double total() const { return think + act; }
+};
+
+// How AI pilots fly and shoot. Angles are in degrees, clockwise with 0
+// pointing up, like CDirection.
+struct AIHandling {
+    float sensorRange;      // how far away a pilot notices a target
+    float turnRate;         // degrees per second
+    float fireRange;        // only targets this close are shot at
+    float fireCone;         // ... and only when the ship points this close to them
+    float fireInterval;     // seconds between two shots of one ship
+};
+
+// Points that pilots can target, bucketed into a uniform grid so that the
+// nearest one to a pilot is found by looking at a few cells only. The grid
+// is rebuilt from scratch whenever the targets move; the buckets are one
+// array sorted by cell, so a rebuild at a steady size does not allocate.
+class TargetGrid {
+public:
+    void reset(float width, float height, float cellSize) {
+        mCellSize = cellSize;
+        mColumns = std::max(1, static_cast<int>(std::ceil(width / cellSize)));
+        mRows = std::max(1, static_cast<int>(std::ceil(height / cellSize)));
+        mX.clear();
+        mY.clear();
+    }
+
+    void add(float x, float y) {
+        mX.push_back(x);
+        mY.push_back(y);
+    }
+
+    // Sorts the added points into their cells (a counting sort, so points
+    // keep the order they were added in within a cell).
+    void build() {
+        mCellStart.assign(mColumns * mRows + 1, 0);
+        mCells.resize(mX.size());
+        for (std::size_t i = 0; i < mX.size(); ++i) {
+            mCells[i] = cellOf(mX[i], mY[i]);
+            ++mCellStart[mCells[i] + 1];
+        }
+        for (std::size_t c = 1; c < mCellStart.size(); ++c) mCellStart[c] += mCellStart[c - 1];
+
+        mSortedX.resize(mX.size());
+        mSortedY.resize(mX.size());
+        mFill.assign(mCellStart.begin(), mCellStart.end() - 1);
+        for (std::size_t i = 0; i < mX.size(); ++i) {
+            std::size_t slot = mFill[mCells[i]]++;
+            mSortedX[slot] = mX[i];
+            mSortedY[slot] = mY[i];
+        }
+    }
+
+    std::size_t size() const { return mX.size(); }
+
+    // The nearest point within `range` of (x, y). Returns false if there
+    // is none.
+    bool nearest(float x, float y, float range, float& targetX, float& targetY) const {
+        int column0 = std::max(0, static_cast<int>(std::floor((x - range) / mCellSize)));
+        int column1 = std::min(mColumns - 1, static_cast<int>(std::floor((x + range) / mCellSize)));
+        int row0 = std::max(0, static_cast<int>(std::floor((y - range) / mCellSize)));
+        int row1 = std::min(mRows - 1, static_cast<int>(std::floor((y + range) / mCellSize)));
+
+        float best = range * range;
+        bool found = false;
+        for (int row = row0; row <= row1; ++row) {
+            for (int column = column0; column <= column1; ++column) {
+                int cell = row * mColumns + column;
+                for (std::size_t i = mCellStart[cell]; i < mCellStart[cell + 1]; ++i) {
+                    float dx = mSortedX[i] - x;
+                    float dy = mSortedY[i] - y;
+                    float d = dx * dx + dy * dy;
+                    if (d < best) {
+                        best = d;
+                        targetX = mSortedX[i];
+                        targetY = mSortedY[i];
+                        found = true;
+                    }
+                }
+            }
+        }
+        return found;
+    }
+
+private:
+    int cellOf(float x, float y) const {
+        int column = std::max(0, std::min(mColumns - 1, static_cast<int>(x / mCellSize)));
+        int row = std::max(0, std::min(mRows - 1, static_cast<int>(y / mCellSize)));
+        return row * mColumns + column;
+    }
+
+    float mCellSize{1.0f};
+    int mColumns{1}, mRows{1};
+    std::vector<float> mX, mY;
+    std::vector<int> mCells;
+    std::vector<std::size_t> mCellStart, mFill;
+    std::vector<float> mSortedX, mSortedY;
+};
+
+// Decision making for AI pilots, in two phases:
+//
+// - Thinking picks each pilot's target with a query of the TargetGrid. It
+//   is the expensive part, so the caller only hands in a slice of the
+//   pilots each tick (round robin, up to a budget) and the others keep
+//   their last decision. A slice can be split between worker threads.
+// - Acting turns every pilot toward its target and decides whether it
+//   fires, each tick, in one pass over structure-of-arrays data.
+//
+// Both only depend on the data passed in, and threads work on disjoint
+// parts of a slice, so the decisions are the same for any number of
+// threads and the simulation stays deterministic.
+class AIPilots {
+public:
+    // Up to `threads` threads think, including the caller's.
+    explicit AIPilots(unsigned threads) {
+        for (unsigned i = 1; i < std::max(1u, threads); ++i) {
+            mWorkers.emplace_back(&AIPilots::workerLoop, this, i);
+        }
+    }
+
+    ~AIPilots() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+        for (auto& worker : mWorkers) worker.join();
+    }
+
+    AIPilots(const AIPilots&) = delete;
+    AIPilots& operator=(const AIPilots&) = delete;
+
+    unsigned threads() const { return static_cast<unsigned>(mWorkers.size()) + 1; }
+
+    TargetGrid& targets() { return mTargets; }
+
+    // Thinking: set the positions of the `count` pilots of this slice,
+    // think, then read each one's decision.
+    void beginThink(std::size_t count) {
+        mThinkCount = count;
+        if (mThinkX.size() < count) {
+            for (auto* v : {&mThinkX, &mThinkY, &mDecisionX, &mDecisionY}) v->resize(count);
+            mDecided.resize(count);
+        }
+    }
+
+    void setThinker(std::size_t i, float x, float y) {
+        mThinkX[i] = x;
+        mThinkY[i] = y;
+    }
+
+    void think(float sensorRange) {
+        mSensorRange = sensorRange;
+        if (mWorkers.empty() || mThinkCount < threads()) {
+            thinkPart(0, 1);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mGeneration;
+            mPending = mWorkers.size();
+        }
+        mWake.notify_all();
+
+        thinkPart(0, threads());
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this] { return mPending == 0; });
+    }
+
+    bool decided(std::size_t i) const { return mDecided[i] != 0; }
+    float decisionX(std::size_t i) const { return mDecisionX[i]; }
+    float decisionY(std::size_t i) const { return mDecisionY[i]; }
+
+    // Acting: set every pilot's state, act, then read the results back.
+    // `spin` is how fast a pilot without a target turns.
+    void beginAct(std::size_t count) {
+        mActCount = count;
+        if (mX.size() < count) {
+            for (auto* v : {&mX, &mY, &mAngle, &mSpin, &mTargetX, &mTargetY, &mCooldown}) v->resize(count);
+            mHasTarget.resize(count);
+            mFires.resize(count);
+        }
+    }
+
+    void setActor(std::size_t i, float x, float y, float angle, float spin,
+                  bool hasTarget, float targetX, float targetY, float cooldown) {
+        mX[i] = x;
+        mY[i] = y;
+        mAngle[i] = angle;
+        mSpin[i] = spin;
+        mHasTarget[i] = hasTarget;
+        mTargetX[i] = targetX;
+        mTargetY[i] = targetY;
+        mCooldown[i] = cooldown;
+    }
+
+    void act(float ft, const AIHandling& handling) {
+        const float degrees = static_cast<float>(180.0 / M_PI);
+        const float maxTurn = handling.turnRate * ft;
+        const float fireRangeSq = handling.fireRange * handling.fireRange;
+
+        for (std::size_t i = 0; i < mActCount; ++i) {
+            float dx = mTargetX[i] - mX[i];
+            float dy = mTargetY[i] - mY[i];
+
+            // Heading toward the target, and how far to turn to face it
+            // (in (-180, 180]).
+            float desired = Kinematics::fastAtan2(dx, -dy) * degrees;
+            float error = desired - mAngle[i];
+            error -= 360.0f * std::floor((error + 180.0f) / 360.0f);
+            float turn = std::max(-maxTurn, std::min(maxTurn, error));
+
+            float cooldown = std::max(0.0f, mCooldown[i] - ft);
+            bool fires = mHasTarget[i] && cooldown == 0.0f && dx * dx + dy * dy < fireRangeSq
+                && std::fabs(error - turn) < handling.fireCone;
+
+            mAngle[i] = Kinematics::wrapDegrees(mAngle[i] + (mHasTarget[i] ? turn : mSpin[i] * ft));
+            mCooldown[i] = fires ? handling.fireInterval : cooldown;
+            mFires[i] = fires;
+        }
+    }
+
+    float angle(std::size_t i) const { return mAngle[i]; }
+    float cooldown(std::size_t i) const { return mCooldown[i]; }
+    bool fires(std::size_t i) const { return mFires[i] != 0; }
+
+private:
+    // Each thread takes an equal share of the slice.
+    void thinkPart(unsigned part, unsigned parts) {
+        std::size_t begin = mThinkCount * part / parts;
+        std::size_t end = mThinkCount * (part + 1) / parts;
+        for (std::size_t i = begin; i < end; ++i) {
+            mDecided[i] = mTargets.nearest(mThinkX[i], mThinkY[i], mSensorRange, mDecisionX[i], mDecisionY[i]);
+        }
+    }
+
+    void workerLoop(unsigned part) {
+        Uint64 seen = 0;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWake.wait(lock, [&] { return mStopping || mGeneration != seen; });
+            if (mStopping) return;
+            seen = mGeneration;
+
+            lock.unlock();
+            thinkPart(part, threads());
+            lock.lock();
+
+            if (--mPending == 0) mDone.notify_one();
+        }
+    }
+
+    TargetGrid mTargets;
+
+    // The slice being thought about, written before the workers are woken.
+    std::size_t mThinkCount{0};
+    float mSensorRange{0.0f};
+    std::vector<float> mThinkX, mThinkY;
+    std::vector<float> mDecisionX, mDecisionY;
+    std::vector<Uint8> mDecided;
+
+    std::size_t mActCount{0};
+    std::vector<float> mX, mY, mAngle, mSpin;
+    std::vector<float> mTargetX, mTargetY, mCooldown;
+    std::vector<Uint8> mHasTarget, mFires;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    Uint64 mGeneration{0};
+    std::size_t mPending{0};
+    bool mStopping{false};
+    std::vector<std::thread> mWorkers;
+};
+
+#endif
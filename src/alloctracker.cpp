@@ -0,0 +1,94 @@
+#include "alloctracker.h"
+
+#if defined(BLACKHOLE_TRACK_ALLOCATIONS)
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Replacements for the global allocation functions. They must not allocate
+// themselves, so reporting uses stdio rather than iostreams, and the state
+// is plain atomics and thread_locals.
+namespace {
+    std::atomic<std::uint64_t> gAllocations[AllocTracker::TAG_COUNT];
+    std::atomic<std::uint64_t> gBytes[AllocTracker::TAG_COUNT];
+    std::atomic<std::uint64_t> gViolations{0};
+    std::atomic<int> gPolicy{static_cast<int>(AllocTracker::HotPolicy::Ignore)};
+
+    thread_local AllocTracker::Tag tTag = AllocTracker::TAG_OTHER;
+    thread_local const char* tHotRegion = nullptr;
+
+    void count(std::size_t size) {
+        gAllocations[tTag].fetch_add(1, std::memory_order_relaxed);
+        gBytes[tTag].fetch_add(size, std::memory_order_relaxed);
+
+        if (tHotRegion == nullptr) return;
+
+        gViolations.fetch_add(1, std::memory_order_relaxed);
+        auto policy = static_cast<AllocTracker::HotPolicy>(gPolicy.load(std::memory_order_relaxed));
+        if (policy == AllocTracker::HotPolicy::Ignore) return;
+
+        std::fprintf(stderr, "Allocation of %zu bytes in hot region \"%s\" (tag %s)\n",
+                     size, tHotRegion, AllocTracker::tagName(tTag));
+        if (policy == AllocTracker::HotPolicy::Abort) std::abort();
+    }
+
+    void* allocate(std::size_t size) {
+        count(size);
+        void* p = std::malloc(size ? size : 1);
+        if (p == nullptr) throw std::bad_alloc();
+        return p;
+    }
+}
+
+namespace AllocTracker {
+    Tag setTag(Tag tag) {
+        Tag previous = tTag;
+        tTag = tag;
+        return previous;
+    }
+
+    void enterHot(const char* region) { tHotRegion = region; }
+    void leaveHot(const char* previous) { tHotRegion = previous; }
+    const char* hotRegion() { return tHotRegion; }
+
+    void setHotPolicy(HotPolicy policy) {
+        gPolicy.store(static_cast<int>(policy), std::memory_order_relaxed);
+    }
+
+    Frame takeFrame() {
+        Frame frame;
+        for (int t = 0; t < TAG_COUNT; ++t) {
+            frame.tags[t].allocations = gAllocations[t].exchange(0, std::memory_order_relaxed);
+            frame.tags[t].bytes = gBytes[t].exchange(0, std::memory_order_relaxed);
+        }
+        return frame;
+    }
+
+    std::uint64_t hotViolations() {
+        return gViolations.load(std::memory_order_relaxed);
+    }
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    count(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    count(size);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef BlackHole_alloctracker_h
+#define BlackHole_alloctracker_h
+
+#include <cstddef>
+#include <cstdint>
+
+// Opt-in allocation instrumentation. Building with
+// BLACKHOLE_TRACK_ALLOCATIONS defined replaces the global operator new
+// (see alloctracker.cpp) with one that counts every allocation and its size
+// against the current thread's tag. Without it, everything here compiles to
+// nothing and the counts stay at zero.
+//
+// Code marks what it is doing with a Scope, and marks code that must not
+// allocate at all with a HotRegion. What happens when a hot region does
+// allocate is up to the HotPolicy.
+namespace AllocTracker {
+    enum Tag {
+        TAG_OTHER,
+        TAG_INPUT,
+        TAG_SIMULATION,
+        TAG_COLLISION,
+        TAG_PARTICLES,
+        TAG_STREAMING,
+        TAG_SNAPSHOT,
+        TAG_NETWORK,
+        TAG_RENDER,
+        TAG_CAPTURE,
+        TAG_COUNT
+    };
+
+    inline const char* tagName(Tag tag) {
+        static const char* const names[TAG_COUNT] = {
+            "other", "input", "simulation", "collision", "particles",
+            "streaming", "snapshot", "network", "render", "capture"
+        };
+        return names[tag];
+    }
+
+    struct Counts {
+        std::uint64_t allocations{0};
+        std::uint64_t bytes{0};
+    };
+
+    // Allocations made by all threads since the previous takeFrame().
+    struct Frame {
+        Counts tags[TAG_COUNT];
+
+        Counts total() const {
+            Counts sum;
+            for (auto& t : tags) {
+                sum.allocations += t.allocations;
+                sum.bytes += t.bytes;
+            }
+            return sum;
+        }
+    };
+
+    enum class HotPolicy {
+        Ignore,     // only count the violation
+        Report,     // print each violation to stderr
+        Abort       // print the violation and abort, for a debugger or core
+    };
+
+#if defined(BLACKHOLE_TRACK_ALLOCATIONS)
+    constexpr bool kEnabled = true;
+
+    // Defined in alloctracker.cpp
+    Tag setTag(Tag tag);
+    void enterHot(const char* region);
+    void leaveHot(const char* previous);
+    const char* hotRegion();
+    void setHotPolicy(HotPolicy policy);
+    Frame takeFrame();
+    std::uint64_t hotViolations();
+#else
+    constexpr bool kEnabled = false;
+
+    inline Tag setTag(Tag tag) { return tag; }
+    inline void enterHot(const char*) { }
+    inline void leaveHot(const char*) { }
+    inline const char* hotRegion() { return nullptr; }
+    inline void setHotPolicy(HotPolicy) { }
+    inline Frame takeFrame() { return Frame(); }
+    inline std::uint64_t hotViolations() { return 0; }
+#endif
+
+    // Counts this thread's allocations against `tag` until it goes out of
+    // scope.
+    class Scope {
+    public:
+        explicit Scope(Tag tag) : mPrevious(setTag(tag)) { }
+        ~Scope() { setTag(mPrevious); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Tag mPrevious;
+    };
+
+    // Code that must not allocate, e.g. a steady-state tick. Regions nest;
+    // the innermost name is reported.
+    class HotRegion {
+    public:
+        explicit HotRegion(const char* name) : mPrevious(hotRegion()) { enterHot(name); }
+        ~HotRegion() { leaveHot(mPrevious); }
+
+        HotRegion(const HotRegion&) = delete;
+        HotRegion& operator=(const HotRegion&) = delete;
+
+    private:
+        const char* mPrevious;
+    };
+
+    // Lets a hot region allocate on purpose (e.g. paging in a chunk)
+    // without counting it as a violation.
+    class ColdRegion {
+    public:
+        ColdRegion() : mPrevious(hotRegion()) { enterHot(nullptr); }
+        ~ColdRegion() { leaveHot(mPrevious); }
+
+        ColdRegion(const ColdRegion&) = delete;
+        ColdRegion& operator=(const ColdRegion&) = delete;
+
+    private:
+        const char* mPrevious;
+    };
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef BlackHole_animationtimelines_h
+#define BlackHole_animationtimelines_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "spriteanimation.h"
+
+// Clocks for sprite animations. Every entity playing the same clip at the
+// same rate shares one timeline, and the timelines follow the simulation
+// tick, which is advanced once per tick for all of them. An entity only
+// keeps the tick it started the clip on (its phase, for a looping clip).
+//
+// A timeline holds the frame shown on each tick of the clip, so finding an
+// entity's frame is one index into that table.
+class AnimationTimelines {
+public:
+    using TimelineID = Uint16;
+
+    // A clip of `animation` lasting `duration` seconds at the given tick
+    // rate. Looping clips start over, others hold their last frame.
+    TimelineID add(std::shared_ptr<SpriteAnimation> animation, float duration, Uint32 ticksPerSecond, bool loop) {
+        Timeline timeline;
+        timeline.animation = animation;
+        timeline.loop = loop;
+
+        // Each frame gets an equal share of the ticks, the last one too.
+        Uint32 length = std::max(1u, static_cast<Uint32>(std::lround(duration * ticksPerSecond)));
+        int numFrames = animation->numFrames();
+        timeline.frames.resize(length);
+        for (Uint32 t = 0; t < length; ++t) {
+            timeline.frames[t] = static_cast<Uint16>(static_cast<Uint64>(t) * numFrames / length);
+        }
+
+        if (mTimelines.size() > 0xFFFF) {
+            throw std::runtime_error("Too many animation timelines.");
+        }
+        mTimelines.push_back(std::move(timeline));
+        return static_cast<TimelineID>(mTimelines.size() - 1);
+    }
+
+    void advance(Uint32 tick) { mTick = tick; }
+
+    Uint32 tick() const { return mTick; }
+
+    SpriteAnimation& animation(TimelineID id) const { return *mTimelines[id].animation; }
+
+    // The frame an entity that started the clip on tick `start` shows now.
+    int frame(TimelineID id, Uint32 start) const {
+        const Timeline& timeline(mTimelines[id]);
+        Uint32 elapsed = mTick - start;
+        Uint32 length = static_cast<Uint32>(timeline.frames.size());
+
+        if (timeline.loop) return timeline.frames[elapsed % length];
+        return timeline.frames[std::min(elapsed, length - 1)];
+    }
+
+    // How many ticks one play of a clip lasts. A clip that does not loop
+    // has played through `length` ticks after it started.
+    Uint32 length(TimelineID id) const { return static_cast<Uint32>(mTimelines[id].frames.size()); }
+
+    bool loops(TimelineID id) const { return mTimelines[id].loop; }
+
+private:
+    struct Timeline {
+        std::shared_ptr<SpriteAnimation> animation;
+        std::vector<Uint16> frames;     // frame shown on each tick of the clip
+        bool loop;
+    };
+
+    std::vector<Timeline> mTimelines;
+    Uint32 mTick{0};
+};
+
+#endif
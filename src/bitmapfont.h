@@ -0,0 +1,235 @@
+#ifndef BlackHole_bitmapfont_h
+#define BlackHole_bitmapfont_h
+
+#include <SDL2/SDL.h>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "renderstats.h"
+#include "texture.h"
+
+// A fixed-width 5x7 pixel font for printable ASCII, rasterized once into
+// an atlas texture. Each glyph sits in a 6x8 cell, so the blank column and
+// row space the characters when cells are placed side by side. The atlas
+// is white, with the glyphs' shapes in its alpha, so text can be drawn in
+// any color by modulating it.
+class BitmapFont {
+public:
+    static constexpr int kCellWidth = 6;
+    static constexpr int kCellHeight = 8;
+    static constexpr char kFirst = ' ';
+    static constexpr char kLast = '~';
+
+    explicit BitmapFont(SDL_Renderer* renderer)
+    : mRenderer(renderer)
+    {
+        const int glyphs = kLast - kFirst + 1;
+        mRows = (glyphs + kColumns - 1) / kColumns;
+        mWidth = kColumns * kCellWidth;
+        mHeight = mRows * kCellHeight;
+
+        mAtlas = make_shared(SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                               mWidth, mHeight));
+        if (!mAtlas) {
+            throw std::runtime_error("Unable to create the font atlas texture.");
+        }
+
+        std::vector<Uint32> pixels(mWidth * mHeight, 0x00FFFFFF);
+        for (int g = 0; g < glyphs; ++g) {
+            SDL_Rect cell(glyphRect(static_cast<char>(kFirst + g)));
+            for (int column = 0; column < 5; ++column) {
+                Uint8 bits = glyphColumns(g)[column];
+                for (int row = 0; row < 7; ++row) {
+                    if (bits & (1 << row)) pixels[(cell.y + row) * mWidth + cell.x + column] = 0xFFFFFFFF;
+                }
+            }
+        }
+        SDL_UpdateTexture(mAtlas.get(), NULL, pixels.data(), mWidth * sizeof(Uint32));
+        SDL_SetTextureBlendMode(mAtlas.get(), SDL_BLENDMODE_BLEND);
+    }
+
+    BitmapFont(const BitmapFont&) = delete;
+    BitmapFont& operator=(const BitmapFont&) = delete;
+
+    // The cell of a character in the atlas. Characters the font does not
+    // have are drawn as '?'.
+    SDL_Rect glyphRect(char c) const {
+        int g = (c < kFirst || c > kLast ? '?' : c) - kFirst;
+        return SDL_Rect{(g % kColumns) * kCellWidth, (g / kColumns) * kCellHeight, kCellWidth, kCellHeight};
+    }
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    SDL_Texture* getSDLTexture() const { return mAtlas.get(); }
+    SDL_Renderer* getRenderer() const { return mRenderer; }
+
+private:
+    static constexpr int kColumns = 16;
+
+    // The pixels of glyph `g`, column by column with the lowest bit at the
+    // top: the classic 5x7 LCD font.
+    static const Uint8* glyphColumns(int g) {
+        static const Uint8 glyphs[kLast - kFirst + 1][5] = {
+            {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+            {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+            {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},
+            {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+            {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+            {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+            {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10},
+            {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+            {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00},
+            {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+            {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E},
+            {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+            {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01},
+            {0x3E, 0x41, 0x49, 0x49, 0x7A}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+            {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},
+            {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+            {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},
+            {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+            {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, {0x63, 0x14, 0x08, 0x14, 0x63},
+            {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+            {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+            {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+            {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7F},
+            {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},
+            {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00},
+            {0x7F, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+            {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7C, 0x14, 0x14, 0x14, 0x08},
+            {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+            {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C},
+            {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},
+            {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7F, 0x00, 0x00},
+            {0x00, 0x41, 0x36, 0x08, 0x00}, {0x10, 0x08, 0x08, 0x10, 0x08}
+        };
+        return glyphs[g];
+    }
+
+    SDL_Renderer* mRenderer;
+    SharedSDLTexture mAtlas;
+    int mRows, mWidth, mHeight;
+};
+
+// Strings laid out in a BitmapFont, as one quad per glyph. The quads stay
+// until clear(), so text that does not change is laid out once and drawn
+// every frame as is; drawing is a single SDL_RenderGeometry call for the
+// whole batch. Once the batch has held its longest text, laying out more
+// does not allocate.
+class TextBatch {
+public:
+    explicit TextBatch(std::shared_ptr<BitmapFont> font)
+    : mFont(font)
+    {
+    }
+
+    // Makes room for `glyphs` glyphs up front.
+    void reserve(std::size_t glyphs) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        mVertices.reserve(glyphs * 4);
+        mIndices.reserve(glyphs * 6);
+#else
+        mGlyphs.reserve(glyphs);
+#endif
+    }
+
+    void clear() {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        mVertices.clear();
+        mIndices.clear();
+#else
+        mGlyphs.clear();
+#endif
+    }
+
+    // Lays out `text` with its top left corner at (x, y), each font pixel
+    // drawn `scale` x `scale`. A '\n' starts a new line under x. Returns
+    // the bottom of the text.
+    int add(int x, int y, const char* text, SDL_Color color, int scale = 1) {
+        const int cellWidth = BitmapFont::kCellWidth * scale;
+        const int cellHeight = BitmapFont::kCellHeight * scale;
+        int penX = x;
+        for (const char* c = text; *c != '\0'; ++c) {
+            if (*c == '\n') {
+                penX = x;
+                y += cellHeight;
+                continue;
+            }
+            if (*c != ' ') addGlyph(mFont->glyphRect(*c), SDL_Rect{penX, y, cellWidth, cellHeight}, color);
+            penX += cellWidth;
+        }
+        return y + cellHeight;
+    }
+
+    // The size of `text` laid out at `scale`.
+    static SDL_Rect measure(const char* text, int scale = 1) {
+        int columns = 0, widest = 0, lines = 1;
+        for (const char* c = text; *c != '\0'; ++c) {
+            if (*c == '\n') {
+                columns = 0;
+                ++lines;
+            } else if (++columns > widest) {
+                widest = columns;
+            }
+        }
+        return SDL_Rect{0, 0, widest * BitmapFont::kCellWidth * scale, lines * BitmapFont::kCellHeight * scale};
+    }
+
+    // Called by Renderer
+    void draw() const {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        if (mVertices.empty()) return;
+        SDL_RenderGeometry(mFont->getRenderer(), mFont->getSDLTexture(),
+                           mVertices.data(), static_cast<int>(mVertices.size()),
+                           mIndices.data(), static_cast<int>(mIndices.size()));
+        RenderStats::countDrawCall();
+#else
+        // Older SDL has no geometry API, so fall back to one copy per glyph.
+        SDL_Texture* atlas = mFont->getSDLTexture();
+        for (const Glyph& glyph : mGlyphs) {
+            SDL_SetTextureColorMod(atlas, glyph.color.r, glyph.color.g, glyph.color.b);
+            SDL_SetTextureAlphaMod(atlas, glyph.color.a);
+            SDL_RenderCopy(mFont->getRenderer(), atlas, &glyph.src, &glyph.dest);
+        }
+        RenderStats::countDrawCall(static_cast<Uint32>(mGlyphs.size()));
+#endif
+    }
+
+private:
+    void addGlyph(const SDL_Rect& src, const SDL_Rect& dest, SDL_Color color) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        const float invW = 1.0f / mFont->width();
+        const float invH = 1.0f / mFont->height();
+        float left = dest.x, right = dest.x + dest.w;
+        float top = dest.y, bottom = dest.y + dest.h;
+        float u0 = src.x * invW, u1 = (src.x + src.w) * invW;
+        float v0 = src.y * invH, v1 = (src.y + src.h) * invH;
+
+        int base = static_cast<int>(mVertices.size());
+        mVertices.push_back({{left, top}, color, {u0, v0}});
+        mVertices.push_back({{right, top}, color, {u1, v0}});
+        mVertices.push_back({{right, bottom}, color, {u1, v1}});
+        mVertices.push_back({{left, bottom}, color, {u0, v1}});
+        for (int corner : {0, 1, 2, 0, 2, 3}) mIndices.push_back(base + corner);
+#else
+        mGlyphs.push_back({src, dest, color});
+#endif
+    }
+
+    std::shared_ptr<BitmapFont> mFont;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> mVertices;
+    std::vector<int> mIndices;
+#else
+    struct Glyph {
+        SDL_Rect src, dest;
+        SDL_Color color;
+    };
+    std::vector<Glyph> mGlyphs;
+#endif
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef BlackHole_camera_h
+#define BlackHole_camera_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+
+// A view of the world the size of the window. Everything in the game lives
+// in world coordinates; drawing subtracts the camera's top left corner, and
+// the culling stage skips whatever the view does not overlap.
+class Camera {
+public:
+    Camera(float viewWidth, float viewHeight, float worldWidth, float worldHeight)
+    : mViewWidth(viewWidth), mViewHeight(viewHeight), mWorldWidth(worldWidth), mWorldHeight(worldHeight)
+    {
+    }
+
+    // Centers the view on a world position, without looking past the
+    // edges of the world.
+    void centerOn(float x, float y) {
+        mLeft = x - mViewWidth / 2.0f;
+        mTop = y - mViewHeight / 2.0f;
+        clamp();
+    }
+
+    void move(float dx, float dy) {
+        mLeft += dx;
+        mTop += dy;
+        clamp();
+    }
+
+    float left() const { return mLeft; }
+    float top() const { return mTop; }
+    float right() const { return mLeft + mViewWidth; }
+    float bottom() const { return mTop + mViewHeight; }
+
+    // Whether a world space box overlaps the view.
+    bool isVisible(float left, float top, float right, float bottom) const {
+        return right >= mLeft && left <= this->right() && bottom >= mTop && top <= this->bottom();
+    }
+
+    // Same, for a box that is drawn rotated about its center: its corners
+    // never leave the circle through them.
+    bool isVisibleRotated(const SDL_Rect& rect) const {
+        float cx = rect.x + rect.w / 2.0f;
+        float cy = rect.y + rect.h / 2.0f;
+        float radius = 0.5f * std::sqrt(1.0f * rect.w * rect.w + 1.0f * rect.h * rect.h);
+        return isVisible(cx - radius, cy - radius, cx + radius, cy + radius);
+    }
+
+    SDL_Rect toScreen(const SDL_Rect& rect) const {
+        return SDL_Rect{rect.x - screenX(), rect.y - screenY(), rect.w, rect.h};
+    }
+
+    // The offset is rounded once, so neighbouring sprites do not shift
+    // against each other while the camera scrolls.
+    int screenX() const { return static_cast<int>(std::floor(mLeft)); }
+    int screenY() const { return static_cast<int>(std::floor(mTop)); }
+
+private:
+    void clamp() {
+        mLeft = std::max(0.0f, std::min(mLeft, mWorldWidth - mViewWidth));
+        mTop = std::max(0.0f, std::min(mTop, mWorldHeight - mViewHeight));
+    }
+
+    float mViewWidth, mViewHeight;
+    float mWorldWidth, mWorldHeight;
+    float mLeft{0.0f};
+    float mTop{0.0f};
+};
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef BlackHole_chunkstore_h
+#define BlackHole_chunkstore_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "alloctracker.h"
+#include "snapshot.h"
+
+// Usage counters of a chunk store.
+struct ChunkStats {
+    std::size_t frozen{0};       // chunks frozen right now
+    std::size_t pagedOut{0};     // entities ever written to a chunk
+    std::size_t pagedIn{0};      // entities ever restored from a chunk
+    std::size_t prefetched{0};   // chunks restored from a finished load
+    std::size_t waited{0};       // chunks whose load had to be waited for
+    std::size_t built{0};        // chunks restored without a load queued
+};
+
+// The world is divided into square chunks. Chunks in view are simulated,
+// the others are frozen: their entities are serialized into one blob per
+// chunk and removed from the entity manager, so the live entities (and the
+// cost of a tick) are bounded by the active area, not the world.
+//
+// A background thread rebuilds the entities of frozen chunks that are
+// about to become active into a separate manager. Activating the chunk then
+// only moves the finished entities over. The loader never decides anything:
+// which chunks are active is fixed by `stream`, and an activation waits for
+// (or does) the load itself, so the simulation is the same however fast the
+// thread is.
+//
+// A blob is never modified once written. Freezing more entities into a
+// chunk writes a new blob, so a table of blobs can be kept around by
+// reference (e.g. for rollback) and a finished load is only used if it was
+// made from the chunk's current blob.
+template<typename TManager> class ChunkStore {
+public:
+    using Entity = typename TManager::Entity;
+    using GroupBitset = typename TManager::GroupBitset;
+    using Blob = std::shared_ptr<const std::vector<Uint8>>;
+    using Table = std::vector<Blob>;    // one per chunk; null if not frozen
+
+    // Creates an entity for a record's groups in the given manager. Called
+    // on the loader thread too, so it must not touch anything else.
+    using Builder = std::function<Entity&(TManager&, const GroupBitset&)>;
+
+    // Where an entity is, or false if it is never frozen (e.g. players).
+    using Locator = std::function<bool(const Entity&, float&, float&)>;
+
+    ChunkStore(float worldWidth, float worldHeight, float chunkSize, Builder build)
+    : mChunkSize(chunkSize),
+    mColumns(static_cast<int>(std::ceil(worldWidth / chunkSize))),
+    mRows(static_cast<int>(std::ceil(worldHeight / chunkSize))),
+    mTable(mColumns * mRows),
+    mBuild(std::move(build)),
+    mThread(&ChunkStore::loaderLoop, this)
+    {
+    }
+
+    ~ChunkStore() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+        mThread.join();
+    }
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    int columns() const { return mColumns; }
+    int rows() const { return mRows; }
+    std::size_t count() const { return mTable.size(); }
+
+    // The chunk containing a position; positions outside the world belong
+    // to the nearest chunk.
+    std::size_t chunkAt(float x, float y) const {
+        int column = std::max(0, std::min(mColumns - 1, static_cast<int>(std::floor(x / mChunkSize))));
+        int row = std::max(0, std::min(mRows - 1, static_cast<int>(std::floor(y / mChunkSize))));
+        return static_cast<std::size_t>(row * mColumns + column);
+    }
+
+    // Chunks that overlap a box in world coordinates.
+    void markRect(float left, float top, float right, float bottom, std::vector<bool>& chunks) const {
+        std::size_t first = chunkAt(left, top);
+        std::size_t last = chunkAt(right, bottom);
+
+        for (int r = static_cast<int>(first) / mColumns; r <= static_cast<int>(last) / mColumns; ++r) {
+            for (int c = static_cast<int>(first) % mColumns; c <= static_cast<int>(last) % mColumns; ++c) {
+                chunks[r * mColumns + c] = true;
+            }
+        }
+    }
+
+    bool isFrozen(std::size_t chunk) const { return mTable[chunk] != nullptr; }
+
+    // Brings the manager in line with `active` (one flag per chunk): frozen
+    // chunks that are active again are restored, and entities standing in
+    // an inactive chunk are frozen into it and destroyed.
+    void stream(TManager& manager, const std::vector<bool>& active, const Locator& locate) {
+        for (std::size_t c = 0; c < mTable.size(); ++c) {
+            if (active[c] && mTable[c]) activate(manager, c);
+        }
+
+        // Records for each chunk are gathered first, so a chunk gets one
+        // new blob however many entities join it.
+        mPending.resize(mTable.size());
+        float x, y;
+        for (auto& e : manager.getEntities()) {
+            if (!e->isAlive() || !locate(*e, x, y)) continue;
+
+            std::size_t c = chunkAt(x, y);
+            if (active[c]) continue;
+
+            mPending[c].push_back(e.get());
+            e->destroy();
+        }
+
+        for (std::size_t c = 0; c < mTable.size(); ++c) {
+            if (!mPending[c].empty()) freeze(c, mPending[c]);
+            mPending[c].clear();
+        }
+    }
+
+    // Starts loading the frozen chunks flagged in `wanted` in the
+    // background, unless a load of their current blob is already there.
+    // Loads that are no longer wanted are dropped.
+    void prefetch(const std::vector<bool>& wanted) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto unwanted = std::remove_if(mLoads.begin(), mLoads.end(), [&](const std::shared_ptr<Load>& l) {
+            return !wanted[l->chunk] || l->blob != mTable[l->chunk];
+        });
+        mLoads.erase(unwanted, mLoads.end());
+
+        for (std::size_t c = 0; c < mTable.size(); ++c) {
+            if (!wanted[c] || !mTable[c]) continue;
+
+            bool queued = false;
+            for (auto& load : mLoads) {
+                queued = queued || (load->chunk == c && load->blob == mTable[c]);
+            }
+            if (queued) continue;
+
+            std::shared_ptr<Load> load(new Load);
+            load->chunk = c;
+            load->blob = mTable[c];
+            mLoads.push_back(load);
+            mQueue.push_back(load);
+        }
+        mWake.notify_one();
+    }
+
+    const Table& table() const { return mTable; }
+
+    // Goes back to a table taken earlier with `table()`. The caller
+    // restores the matching entities.
+    void restore(const Table& table) {
+        mTable = table;
+    }
+
+    // Layout: chunk count (u32), then per chunk its blob size (u32, zero
+    // if the chunk is not frozen) and the blob.
+    void serialize(SnapshotWriter& writer) const {
+        writer.write(static_cast<Uint32>(mTable.size()));
+        for (auto& blob : mTable) {
+            writer.write(static_cast<Uint32>(blob ? blob->size() : 0));
+            if (blob) writer.writeBytes(blob->data(), blob->size());
+        }
+    }
+
+    void deserialize(SnapshotReader& reader) {
+        if (reader.read<Uint32>() != mTable.size()) {
+            throw std::runtime_error("Snapshot was taken with a different chunk layout.");
+        }
+        for (auto& blob : mTable) {
+            auto size(reader.read<Uint32>());
+            if (size == 0) {
+                blob.reset();
+                continue;
+            }
+
+            std::shared_ptr<std::vector<Uint8>> bytes(new std::vector<Uint8>(size));
+            reader.readBytes(bytes->data(), size);
+            blob = bytes;
+        }
+    }
+
+    ChunkStats stats() const {
+        ChunkStats stats(mStats);
+        stats.frozen = std::count_if(mTable.begin(), mTable.end(), [](const Blob& b) { return b != nullptr; });
+        return stats;
+    }
+
+private:
+    // A chunk rebuilt (or being rebuilt) by the loader.
+    struct Load {
+        std::size_t chunk;
+        Blob blob;
+        TManager staged;
+        bool done{false};
+    };
+
+    // Blob layout: entity count (u32), then one record per entity as
+    // written by Manager::serializeEntity.
+    void freeze(std::size_t chunk, const std::vector<Entity*>& entities) {
+        std::shared_ptr<std::vector<Uint8>> bytes(new std::vector<Uint8>);
+        {
+            SnapshotWriter writer(*bytes);
+            Uint32 count = static_cast<Uint32>(entities.size());
+
+            // Chunks that are frozen already keep their entities first.
+            if (mTable[chunk]) {
+                SnapshotReader previous(*mTable[chunk]);
+                count += previous.read<Uint32>();
+                writer.write(count);
+                writer.writeBytes(mTable[chunk]->data() + sizeof(Uint32), mTable[chunk]->size() - sizeof(Uint32));
+            } else {
+                writer.write(count);
+            }
+
+            for (auto* e : entities) TManager::serializeEntity(*e, writer);
+        }
+
+        mTable[chunk] = bytes;
+        mStats.pagedOut += entities.size();
+    }
+
+    void activate(TManager& manager, std::size_t chunk) {
+        std::shared_ptr<Load> load;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            // Loads of blobs the chunk no longer has are useless now.
+            auto stale = std::remove_if(mLoads.begin(), mLoads.end(), [&](const std::shared_ptr<Load>& l) {
+                return l->chunk == chunk && l->blob != mTable[chunk];
+            });
+            mLoads.erase(stale, mLoads.end());
+
+            for (auto& l : mLoads) {
+                if (l->chunk == chunk) load = l;
+            }
+
+            if (load) {
+                if (load->done) {
+                    ++mStats.prefetched;
+                } else {
+                    ++mStats.waited;
+                    mDone.wait(lock, [&] { return load->done; });
+                }
+                mLoads.erase(std::find(mLoads.begin(), mLoads.end(), load));
+            }
+        }
+
+        if (!load) {
+            ++mStats.built;
+            load.reset(new Load);
+            load->chunk = chunk;
+            load->blob = mTable[chunk];
+            build(*load);
+        }
+
+        mStats.pagedIn += load->staged.getEntities().size();
+        manager.adopt(load->staged);
+        mTable[chunk].reset();
+    }
+
+    void build(Load& load) {
+        SnapshotReader reader(*load.blob);
+        auto count(reader.read<Uint32>());
+        for (Uint32 i = 0; i < count; ++i) {
+            TManager::deserializeEntity(reader, [&](const GroupBitset& groups) -> Entity& {
+                return mBuild(load.staged, groups);
+            });
+        }
+    }
+
+    void loaderLoop() {
+        AllocTracker::Scope tag(AllocTracker::TAG_STREAMING);
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWake.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+            if (mStopping) return;
+
+            std::shared_ptr<Load> load(mQueue.front());
+            mQueue.pop_front();
+
+            lock.unlock();
+            build(*load);
+            lock.lock();
+
+            load->done = true;
+            mDone.notify_all();
+        }
+    }
+
+    float mChunkSize;
+    int mColumns, mRows;
+    Table mTable;
+    Builder mBuild;
+    ChunkStats mStats;
+    std::vector<std::vector<Entity*>> mPending;
+
+    // Shared with the loader thread, under mMutex.
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    std::deque<std::shared_ptr<Load>> mQueue;
+    std::vector<std::shared_ptr<Load>> mLoads;
+    bool mStopping{false};
+
+    std::thread mThread;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef BlackHole_collisionmask_h
+#define BlackHole_collisionmask_h
+
+#include <SDL2/SDL.h>
+#include <SDL2_image/SDL_image.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "sprite.h"
+#include "spriteanimation.h"
+
+// A 1-bit silhouette of a sprite as it is drawn: bit x of row y is set
+// where the sprite covers pixel (x, y). Rows are packed into 64-bit words,
+// so testing two masks against each other costs a few word operations per
+// row.
+class CollisionMask {
+public:
+    CollisionMask(int width, int height)
+    : mWidth(width), mHeight(height), mWordsPerRow((width + 63) / 64), mBits(mWordsPerRow * height, 0)
+    {
+    }
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    void set(int x, int y) {
+        mBits[y * mWordsPerRow + x / 64] |= std::uint64_t(1) << (x % 64);
+    }
+
+    // Whether this mask, with its top left corner at (dx, dy) in `other`'s
+    // pixels, covers any pixel that `other` covers.
+    bool overlaps(const CollisionMask& other, int dx, int dy) const {
+        if (dx >= other.mWidth || dx + mWidth <= 0) return false;
+
+        int yBegin = std::max(0, -dy);
+        int yEnd = std::min(mHeight, other.mHeight - dy);
+        for (int y = yBegin; y < yEnd; ++y) {
+            const std::uint64_t* row = &mBits[y * mWordsPerRow];
+            for (int w = 0; w < mWordsPerRow; ++w) {
+                if (row[w] != 0 && (row[w] & other.window(y + dy, w * 64 + dx)) != 0) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // The 64 bits of row `y` from column `x` on. Columns outside the mask
+    // are clear.
+    std::uint64_t window(int y, int x) const {
+        const std::uint64_t* row = &mBits[y * mWordsPerRow];
+        int word = x >= 0 ? x / 64 : -((63 - x) / 64);
+        int shift = x - word * 64;
+
+        std::uint64_t low = wordAt(row, word);
+        if (shift == 0) return low;
+        return (low >> shift) | (wordAt(row, word + 1) << (64 - shift));
+    }
+
+    std::uint64_t wordAt(const std::uint64_t* row, int word) const {
+        return word >= 0 && word < mWordsPerRow ? row[word] : 0;
+    }
+
+    int mWidth, mHeight;
+    int mWordsPerRow;
+    std::vector<std::uint64_t> mBits;
+};
+
+// The masks of one sprite in every pose it is drawn in: at evenly spaced
+// angles for a rotating sprite, or one per frame of an animation. They are
+// built from the sprite sheet's pixels when the assets are loaded, at the
+// size the sprite is drawn at, and are centered on the sprite's center.
+class CollisionMasks {
+public:
+    // `steps` masks of a sprite drawn `width` x `height` and rotated about
+    // its center. Each is as wide as the sprite's diagonal, like the
+    // cells of a RotationCache.
+    static CollisionMasks rotated(const Sprite& sprite, int width, int height, int steps) {
+        Pixels pixels(sprite.spriteSheet().filename());
+        std::vector<float> covered(coverage(pixels, sprite.subimageRect(), width, height));
+
+        float diagonal = std::sqrt(1.0f * width * width + 1.0f * height * height);
+        int maskWidth = width + 2 * static_cast<int>(std::ceil((diagonal - width) / 2.0f));
+        int maskHeight = height + 2 * static_cast<int>(std::ceil((diagonal - height) / 2.0f));
+
+        CollisionMasks masks;
+        masks.mSteps = steps;
+        for (int i = 0; i < steps; ++i) {
+            // Sprites are drawn rotated clockwise on screen; each mask pixel
+            // is rotated back into the unrotated sprite.
+            double radians = 2.0 * M_PI * i / steps;
+            float c = static_cast<float>(std::cos(radians));
+            float s = static_cast<float>(std::sin(radians));
+
+            CollisionMask mask(maskWidth, maskHeight);
+            for (int y = 0; y < maskHeight; ++y) {
+                for (int x = 0; x < maskWidth; ++x) {
+                    float px = x + 0.5f - maskWidth / 2.0f;
+                    float py = y + 0.5f - maskHeight / 2.0f;
+                    int u = static_cast<int>(std::floor(px * c + py * s + width / 2.0f));
+                    int v = static_cast<int>(std::floor(-px * s + py * c + height / 2.0f));
+
+                    if (u >= 0 && u < width && v >= 0 && v < height && covered[v * width + u] >= 0.5f) {
+                        mask.set(x, y);
+                    }
+                }
+            }
+            masks.mMasks.push_back(mask);
+        }
+        return masks;
+    }
+
+    // One mask per frame of an animation drawn `width` x `height`.
+    static CollisionMasks animated(const SpriteAnimation& animation, int width, int height) {
+        Pixels pixels(animation.spriteSheet().filename());
+
+        CollisionMasks masks;
+        for (int frame = 0; frame < animation.numFrames(); ++frame) {
+            std::vector<float> covered(coverage(pixels, animation.frameRect(frame), width, height));
+
+            CollisionMask mask(width, height);
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    if (covered[y * width + x] >= 0.5f) mask.set(x, y);
+                }
+            }
+            masks.mMasks.push_back(mask);
+        }
+        return masks;
+    }
+
+    // The mask nearest to a rotation, in degrees.
+    const CollisionMask& forAngle(double angle) const {
+        long step = std::lround(angle * mSteps / 360.0) % mSteps;
+        return mMasks[step < 0 ? step + mSteps : step];
+    }
+
+    const CollisionMask& forFrame(int frame) const {
+        return mMasks[frame];
+    }
+
+private:
+    CollisionMasks() = default;
+
+    // The pixels of an image file, as 32-bit ARGB.
+    struct Pixels {
+        explicit Pixels(const std::string& filename)
+        : surface(nullptr, SDL_FreeSurface)
+        {
+            std::unique_ptr<SDL_Surface, void (*)(SDL_Surface*)> loaded(IMG_Load(filename.c_str()), SDL_FreeSurface);
+            if (loaded) {
+                surface.reset(SDL_ConvertSurfaceFormat(loaded.get(), SDL_PIXELFORMAT_ARGB8888, 0));
+            }
+            if (!surface) {
+                std::ostringstream oss;
+                oss << "Unable to read the pixels of " << filename << " for collision masks.";
+                throw std::runtime_error(oss.str());
+            }
+            SDL_LockSurface(surface.get());
+        }
+
+        ~Pixels() {
+            SDL_UnlockSurface(surface.get());
+        }
+
+        // Whether the pixel is drawn: textures are color keyed on white
+        // (see Texture), and mostly transparent pixels do not count either.
+        bool isOpaque(int x, int y) const {
+            if (x < 0 || y < 0 || x >= surface->w || y >= surface->h) return false;
+
+            const Uint8* row = static_cast<const Uint8*>(surface->pixels) + y * surface->pitch;
+            Uint32 argb = reinterpret_cast<const Uint32*>(row)[x];
+            return (argb & 0xFFFFFF) != 0xFFFFFF && (argb >> 24) >= 0x80;
+        }
+
+        std::unique_ptr<SDL_Surface, void (*)(SDL_Surface*)> surface;
+    };
+
+    // The share of each pixel of `src` drawn `width` x `height` that its
+    // source pixels cover.
+    static std::vector<float> coverage(const Pixels& pixels, const SDL_Rect& src, int width, int height) {
+        std::vector<float> covered(width * height, 0.0f);
+        for (int v = 0; v < height; ++v) {
+            int y0 = src.y + v * src.h / height;
+            int y1 = std::max(y0 + 1, src.y + (v + 1) * src.h / height);
+            for (int u = 0; u < width; ++u) {
+                int x0 = src.x + u * src.w / width;
+                int x1 = std::max(x0 + 1, src.x + (u + 1) * src.w / width);
+
+                int opaque = 0;
+                for (int y = y0; y < y1; ++y) {
+                    for (int x = x0; x < x1; ++x) {
+                        opaque += pixels.isOpaque(x, y);
+                    }
+                }
+                covered[v * width + u] = 1.0f * opaque / ((x1 - x0) * (y1 - y0));
+            }
+        }
+        return covered;
+    }
+
+    std::vector<CollisionMask> mMasks;
+    int mSteps{0};
+};
+
+#endif
@@ -10,84 +10,315 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <new>
 #include <algorithm>
-#include <bitset>
 #include <array>
 #include <cassert>
 #include <type_traits>
 #include <cmath>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <stdexcept>
+#include <tuple>
+
+#include "snapshot.h"
 
 namespace EntitySystem
 {
-    struct Component;
-    class Entity;
-    class Manager;
+    template<typename TSettings> struct Component;
+    template<typename TSettings> class Entity;
+    template<typename TSettings> class Manager;
     
     using ComponentID = std::size_t;
     using Group = std::size_t;
+    using PrefabID = std::size_t;
     
-    namespace Internal
+    constexpr PrefabID noPrefab{static_cast<PrefabID>(-1)};
+    
+    // A fixed-size bit set that, unlike std::bitset, can be built and
+    // compared in constant expressions, so component signatures are
+    // computed at compile time.
+    template<std::size_t TBits> struct Bitmask
     {
-        inline ComponentID getUniqueComponentID() noexcept
+        static constexpr std::size_t wordCount{TBits == 0 ? 1 : (TBits + 63) / 64};
+        
+        std::uint64_t words[wordCount]{};
+        
+        constexpr bool operator[](std::size_t mBit) const noexcept
         {
-            static ComponentID lastID{0u};
-            return lastID++;
+            return (words[mBit / 64] >> (mBit % 64)) & 1u;
         }
-    }
+        
+        constexpr void set(std::size_t mBit, bool mValue = true) noexcept
+        {
+            std::uint64_t bit{std::uint64_t(1) << (mBit % 64)};
+            words[mBit / 64] = mValue ? (words[mBit / 64] | bit) : (words[mBit / 64] & ~bit);
+        }
+        
+        // True if every bit set in `mOther` is also set here.
+        constexpr bool contains(const Bitmask& mOther) const noexcept
+        {
+            for(std::size_t i{0}; i < wordCount; ++i)
+                if((words[i] & mOther.words[i]) != mOther.words[i]) return false;
+            return true;
+        }
+        
+        constexpr bool operator==(const Bitmask& mOther) const noexcept
+        {
+            for(std::size_t i{0}; i < wordCount; ++i)
+                if(words[i] != mOther.words[i]) return false;
+            return true;
+        }
+        
+        constexpr bool operator!=(const Bitmask& mOther) const noexcept { return !(*this == mOther); }
+        
+        void serialize(SnapshotWriter& mWriter) const
+        {
+            for(auto w : words) mWriter.write(w);
+        }
+        
+        void deserialize(SnapshotReader& mReader)
+        {
+            for(auto& w : words) mReader.read(w);
+        }
+    };
     
-    template<typename T> inline ComponentID getComponentTypeID() noexcept
+    // The list of every component type a game uses. A component's ID is
+    // its position in the list, resolved at compile time.
+    template<typename... TComponents> struct ComponentList
+    {
+        static constexpr std::size_t size{sizeof...(TComponents)};
+    };
+    
+    namespace Internal
     {
-        static_assert(std::is_base_of<Component, T>::value,
-                      "T must inherit from Component");
+        template<typename T, typename... TComponents> struct IndexOf
+        {
+            // Only reached once the list is exhausted.
+            static_assert(sizeof...(TComponents) != 0,
+                          "T is not in the ComponentList of the entity system's settings");
+        };
+        
+        template<typename T, typename... TRest> struct IndexOf<T, T, TRest...>
+        : std::integral_constant<std::size_t, 0> { };
+        
+        template<typename T, typename TFirst, typename... TRest> struct IndexOf<T, TFirst, TRest...>
+        : std::integral_constant<std::size_t, 1 + IndexOf<T, TRest...>::value> { };
         
-        static ComponentID typeID{Internal::getUniqueComponentID()};
-        return typeID;
+        template<typename T, typename TList> struct ListIndex;
+        template<typename T, typename... TComponents> struct ListIndex<T, ComponentList<TComponents...>>
+        : IndexOf<T, TComponents...> { };
     }
     
-    constexpr std::size_t maxComponents{32};
-    using ComponentBitset = std::bitset<maxComponents>;
-    using ComponentArray = std::array<Component*, maxComponents>;
-    
-    constexpr std::size_t maxGroups{32};
-    using GroupBitset = std::bitset<maxGroups>;
+    // Compile-time configuration of an entity system: its component types
+    // and the number of groups. The bit sets are sized from these, so adding
+    // a component or group never needs a width changed by hand.
+    template<typename TComponentList, std::size_t TGroupCount> struct Settings
+    {
+        static constexpr std::size_t componentCount{TComponentList::size};
+        static constexpr std::size_t groupCount{TGroupCount};
+        
+        using ComponentBitset = Bitmask<componentCount>;
+        using GroupBitset = Bitmask<groupCount>;
+        
+        template<typename T> static constexpr ComponentID componentID() noexcept
+        {
+            static_assert(std::is_base_of<Component<Settings>, T>::value,
+                          "T must inherit from Component");
+            return Internal::ListIndex<T, TComponentList>::value;
+        }
+        
+        // The bits of the given component types, e.g. for matching entities.
+        template<typename... Ts> static constexpr ComponentBitset signature() noexcept
+        {
+            ComponentBitset mask{};
+            const ComponentID ids[]{0, componentID<Ts>()...};
+            for(std::size_t i{1}; i < sizeof...(Ts) + 1; ++i) mask.set(ids[i]);
+            return mask;
+        }
+    };
     
-    struct Component
+    template<typename TSettings> struct Component
     {
-        Entity* entity;
+        Entity<TSettings>* entity;
         
         virtual void init() { }
         virtual void update(float mFT) { }
         virtual void draw() { }
         
+        // The entity was destroyed. It may be freed at the next refresh, or
+        // go back to its prefab pool and be spawned again, so anything that
+        // refers to it from outside (like a timer) must let go here.
+        virtual void destroyed() { }
+        
+        // Components write their mutable state into world snapshots.
+        // Anything set up by the entity's factory is not stored.
+        virtual void serialize(SnapshotWriter& mWriter) const { }
+        virtual void deserialize(SnapshotReader& mReader) { }
+        
         virtual ~Component() { }
     };
     
-    class Entity
+    namespace Internal
     {
+        // One block of memory that the components of a whole batch of
+        // entities are built in, one after the other (see
+        // Manager::spawnBatch). Every component built in it holds a
+        // reference, as does the batch while it builds; the last one to
+        // let go frees the block. Not thread safe: the components must be
+        // destroyed on the thread that owns their manager.
+        class ComponentSlab
+        {
+        public:
+            static constexpr std::size_t alignment{alignof(std::max_align_t)};
+            
+            // The room a component of `mSize` bytes takes up in a slab.
+            static constexpr std::size_t footprint(std::size_t mSize) noexcept
+            {
+                return (mSize + alignment - 1) / alignment * alignment;
+            }
+            
+            explicit ComponentSlab(std::size_t mBytes)
+                : memory(static_cast<char*>(::operator new(mBytes))), capacity(mBytes) { }
+            
+            ComponentSlab(const ComponentSlab&) = delete;
+            ComponentSlab& operator=(const ComponentSlab&) = delete;
+            
+            // Room for a component, or nullptr if the slab is full. The
+            // caller takes a reference once the component is built in it.
+            void* allocate(std::size_t mSize) noexcept
+            {
+                std::size_t bytes{footprint(mSize)};
+                if(bytes > capacity - used) return nullptr;
+                
+                void* p{memory + used};
+                used += bytes;
+                return p;
+            }
+            
+            void retain() noexcept { ++references; }
+            
+            void release() noexcept
+            {
+                if(--references != 0) return;
+                ::operator delete(memory);
+                delete this;
+            }
+        
+        private:
+            ~ComponentSlab() { }
+            
+            char* memory;
+            std::size_t capacity;
+            std::size_t used{0};
+            std::size_t references{1};
+        };
+        
+        // Deletes a component built on its own, or destroys one built in a
+        // slab and lets go of the slab.
+        template<typename TSettings> struct ComponentDeleter
+        {
+            ComponentSlab* slab{nullptr};
+            
+            void operator()(Component<TSettings>* mComponent) const noexcept
+            {
+                if(slab == nullptr)
+                {
+                    delete mComponent;
+                    return;
+                }
+                mComponent->~Component();
+                slab->release();
+            }
+        };
+    }
+    
+    template<typename TSettings> class Entity
+    {
+        friend class Manager<TSettings>;
+    
+    public:
+        using ComponentBitset = typename TSettings::ComponentBitset;
+        using GroupBitset = typename TSettings::GroupBitset;
+    
     private:
-        Manager& manager;
+        using ComponentArray = std::array<Component<TSettings>*, TSettings::componentCount>;
+        
+        // A pointer, since Manager::adopt moves entities between managers.
+        Manager<TSettings>* manager;
         
         bool alive{true};
-        std::vector<std::unique_ptr<Component>> components;
+        PrefabID prefab{noPrefab};
+        std::vector<std::unique_ptr<Component<TSettings>, Internal::ComponentDeleter<TSettings>>> components;
+        
+        // Only the components that override update() are called each tick.
+        std::vector<Component<TSettings>*> updatedComponents;
+        
+        // Update scheduling: a sleeping entity is not updated at all, and
+        // one with an interval of n is updated every n-th tick with the time
+        // of all n ticks.
+        bool sleeping{false};
+        std::uint16_t updateInterval{1};
+        std::uint16_t updateCounter{0};
+        float pendingTime{0.f};
+        
+        // The manager's bookkeeping of its active list: the entity's place
+        // in entity order, whether it is in the list, and whether a change
+        // that may move it in or out waits for the next refresh.
+        std::uint64_t sequence{0};
+        bool inActive{false};
+        bool changed{false};
+        
         ComponentArray componentArray;
         ComponentBitset componentBitset;
         
         GroupBitset groupBitset;
-        
+    
     public:
-        Entity(Manager& mManager) : manager(mManager) { }
+        Entity(Manager<TSettings>& mManager) : manager(&mManager) { }
         
-        void update(float mFT) 	{ for(auto& c : components) c->update(mFT); }
+        void update(float mFT) 	{ for(auto c : updatedComponents) c->update(mFT); }
         void draw() 			{ for(auto& c : components) c->draw(); }
         
         bool isAlive() const 	{ return alive; }
-        void destroy() 			{ alive = false; }
+        void destroy();
+        
+        // Entities spawned from a prefab go back to its pool when destroyed.
+        PrefabID getPrefab() const noexcept { return prefab; }
+        
+        // A sleeping entity keeps its state but is skipped by
+        // Manager::update until it is woken (from the next tick on).
+        bool isSleeping() const noexcept { return sleeping; }
+        void sleep();
+        void wake();
+        
+        // Updates the entity every `mInterval` ticks only; `mPhase` spreads
+        // entities with the same interval over different ticks.
+        // Time accumulated so far is kept across a change of interval.
+        void setUpdateInterval(std::uint16_t mInterval, std::uint16_t mPhase = 0) noexcept
+        {
+            mInterval = std::max<std::uint16_t>(mInterval, 1);
+            if(mInterval == updateInterval) return;
+            
+            updateInterval = mInterval;
+            updateCounter = mPhase % mInterval;
+        }
+        std::uint16_t getUpdateInterval() const noexcept { return updateInterval; }
+        
+        // True if the entity has something to do in Manager::update.
+        bool needsUpdate() const noexcept { return !sleeping && !updatedComponents.empty(); }
         
         template<typename T> bool hasComponent() const
         {
-            return componentBitset[getComponentTypeID<T>()];
+            return componentBitset[TSettings::template componentID<T>()];
+        }
+        
+        // True if the entity has all of the given components.
+        template<typename... Ts> bool hasComponents() const
+        {
+            return componentBitset.contains(TSettings::template signature<Ts...>());
         }
         
         bool hasGroup(Group mGroup) const noexcept
@@ -96,23 +327,46 @@ namespace EntitySystem
         }
         
         void addGroup(Group mGroup) noexcept;
-        void delGroup(Group mGroup) noexcept
-        {
-            groupBitset[mGroup] = false;
-        }
+        void delGroup(Group mGroup) noexcept;
         
         template<typename T, typename... TArgs>
         T& addComponent(TArgs&&... mArgs)
         {
             assert(!hasComponent<T>());
             
-            T* c(new T(std::forward<TArgs>(mArgs)...));
+            // In the slab of the batch being spawned, if there is one with
+            // room left.
+            Internal::ComponentSlab* slab{manager->slab};
+            void* memory{nullptr};
+            if(slab != nullptr && alignof(T) <= Internal::ComponentSlab::alignment)
+                memory = slab->allocate(sizeof(T));
+            
+            T* c;
+            if(memory != nullptr)
+            {
+                c = new(memory) T(std::forward<TArgs>(mArgs)...);
+                slab->retain();
+            }
+            else
+            {
+                c = new T(std::forward<TArgs>(mArgs)...);
+                slab = nullptr;
+            }
             c->entity = this;
-            std::unique_ptr<Component> uPtr{c};
-            components.emplace_back(std::move(uPtr));
+            components.emplace_back(c, Internal::ComponentDeleter<TSettings>{slab});
+            manager->componentBytes += Internal::ComponentSlab::footprint(sizeof(T));
             
-            componentArray[getComponentTypeID<T>()] = c;
-            componentBitset[getComponentTypeID<T>()] = true;
+            componentArray[TSettings::template componentID<T>()] = c;
+            componentBitset.set(TSettings::template componentID<T>());
+            manager->addToViews(*this, TSettings::template componentID<T>());
+            
+            // A component that does not override update() is static; `&T::update`
+            // then names the base class member.
+            if(!std::is_same<decltype(&T::update), void (Component<TSettings>::*)(float)>::value)
+            {
+                updatedComponents.emplace_back(c);
+                manager->noteChange(*this);
+            }
             
             c->init();
             return *c;
@@ -121,25 +375,182 @@ namespace EntitySystem
         template<typename T> T& getComponent() const
         {
             assert(hasComponent<T>());
-            auto ptr(componentArray[getComponentTypeID<T>()]);
-            return *reinterpret_cast<T*>(ptr);
+            auto ptr(componentArray[TSettings::template componentID<T>()]);
+            return *static_cast<T*>(ptr);
+        }
+        
+        const GroupBitset& getGroupBitset() const noexcept { return groupBitset; }
+        const ComponentBitset& getComponentBitset() const noexcept { return componentBitset; }
+        
+        void serialize(SnapshotWriter& mWriter) const
+        {
+            mWriter.write(sleeping);
+            mWriter.write(updateInterval);
+            mWriter.write(updateCounter);
+            mWriter.write(pendingTime);
+            for(auto& c : components) c->serialize(mWriter);
+        }
+        
+        void deserialize(SnapshotReader& mReader)
+        {
+            mReader.read(sleeping);
+            mReader.read(updateInterval);
+            mReader.read(updateCounter);
+            mReader.read(pendingTime);
+            for(auto& c : components) c->deserialize(mReader);
+            manager->noteChange(*this);
+        }
+    };
+    
+    // Usage counters of a prefab pool.
+    struct PoolStats
+    {
+        std::size_t built{0};       // entities ever constructed for the pool
+        std::size_t inUse{0};       // currently spawned
+        std::size_t highWater{0};   // most ever spawned at once
+        std::size_t misses{0};      // spawns that found the pool empty
+    };
+    
+    namespace Internal
+    {
+        // What a Manager needs of a view, whatever its component types.
+        template<typename TSettings> struct ViewBase
+        {
+            typename TSettings::ComponentBitset signature;
+            
+            virtual void add(Entity<TSettings>& mEntity) = 0;
+            virtual void removeDead() = 0;
+            virtual void clear() = 0;
+            
+            virtual ~ViewBase() { }
+        };
+    }
+    
+    // The entities that have all of the components `Ts`, kept by
+    // Manager::view. Each row holds the entity and pointers to those
+    // components, so iterating a view is a linear scan with no lookups.
+    // Entities join as soon as they get the last of the components, and
+    // destroyed ones leave at the next refresh, like with groups.
+    template<typename TSettings, typename... Ts> class View : public Internal::ViewBase<TSettings>
+    {
+    public:
+        struct Row
+        {
+            Entity<TSettings>* entity;
+            std::tuple<Ts*...> components;
+            
+            template<typename T> T& get() const noexcept { return *std::get<T*>(components); }
+        };
+        
+        using iterator = typename std::vector<Row>::const_iterator;
+        
+        iterator begin() const noexcept { return rows.begin(); }
+        iterator end() const noexcept { return rows.end(); }
+        std::size_t size() const noexcept { return rows.size(); }
+        bool empty() const noexcept { return rows.empty(); }
+        const Row& operator[](std::size_t mIndex) const noexcept { return rows[mIndex]; }
+        
+        // Makes room for `mCount` rows, so the view does not grow until it has more.
+        void reserve(std::size_t mCount) { rows.reserve(mCount); }
+        
+        // Calls `mFunction(entity, components...)` for every row.
+        template<typename TFunction> void forEach(TFunction&& mFunction) const
+        {
+            forEach(mFunction, std::index_sequence_for<Ts...>{});
+        }
+        
+        void add(Entity<TSettings>& mEntity) override
+        {
+            rows.emplace_back(Row{&mEntity, std::make_tuple(&mEntity.template getComponent<Ts>()...)});
         }
+        
+        void removeDead() override
+        {
+            rows.erase(std::remove_if(std::begin(rows), std::end(rows),
+                                      [](const Row& mRow) { return !mRow.entity->isAlive(); }),
+                       std::end(rows));
+        }
+        
+        void clear() override { rows.clear(); }
+    
+    private:
+        template<typename TFunction, std::size_t... Is>
+        void forEach(TFunction& mFunction, std::index_sequence<Is...>) const
+        {
+            for(auto& r : rows) mFunction(*r.entity, *std::get<Is>(r.components)...);
+        }
+        
+        std::vector<Row> rows;
     };
     
-    struct Manager
+    template<typename TSettings> class Manager
     {
+        friend class EntitySystem::Entity<TSettings>;
+    
+    public:
+        using Entity = EntitySystem::Entity<TSettings>;
+        using ComponentBitset = typename TSettings::ComponentBitset;
+        using GroupBitset = typename TSettings::GroupBitset;
+    
     private:
+        // Short-lived entities of one shape (e.g. photon torpedoes) are
+        // built once and recycled: destroyed entities keep their components
+        // and wait in `free` until the next spawn.
+        struct Pool
+        {
+            std::function<void(Entity&)> build;
+            std::vector<std::unique_ptr<Entity>> free;
+            PoolStats stats;
+            std::size_t keep{0};
+            
+            // The prefab's shape, learnt from its first entity, so later
+            // ones can have their storage sized up front.
+            bool shapeKnown{false};
+            std::size_t componentCount{0};
+            std::size_t updatedCount{0};
+            std::size_t componentBytes{0};  // slab room for its components
+            GroupBitset groups;
+        };
+        
         std::vector<std::unique_ptr<Entity>> entities;
-        std::array<std::vector<Entity*>, maxGroups> groupedEntities;
+        std::array<std::vector<Entity*>, TSettings::groupCount> groupedEntities;
+        std::vector<Pool> pools;
+        
+        // The entities update() visits: the alive and awake ones with
+        // something to update, in entity order. refresh() keeps it up to
+        // date from the entities that spawned, died, slept or woke since
+        // (`changed`), so static and sleeping entities cost nothing there
+        // either. `nextSequence` numbers the entities in entity order.
+        std::vector<Entity*> active;
+        std::vector<Entity*> changed;
+        std::uint64_t nextSequence{0};
+        
+        std::vector<std::unique_ptr<Internal::ViewBase<TSettings>>> views;
         
+        // An entity was destroyed or left a group, so the lists need
+        // compacting.
+        bool staleSinceRefresh{false};
+        
+        // While spawnBatch builds entities, the slab their components go
+        // in. `componentBytes` adds up the slab room of every component
+        // built, so a prefab's first entity tells how much its take.
+        Internal::ComponentSlab* slab{nullptr};
+        std::size_t componentBytes{0};
+    
     public:
+        // Only visits the entities that were active at the last refresh.
+        // Entities created or woken during the update join from the next
+        // refresh.
         void update(float ft) 	{
-            // The loop was changed to the old style so that
-            // we could use indices, because some entities
-            // create other entities, which may screw up the previous loop
-            std::size_t N = entities.size();
-            for (int n = 0; n < N; n++) {
-                entities[n]->update( ft );
+            for(auto e : active)
+            {
+                e->pendingTime += ft;
+                if(++e->updateCounter < e->updateInterval) continue;
+                
+                float elapsed{e->pendingTime};
+                e->updateCounter = 0;
+                e->pendingTime = 0.f;
+                e->update(elapsed);
             }
         }
         void draw() 			{ for(auto& e : entities) e->draw(); }
@@ -154,9 +565,49 @@ namespace EntitySystem
             return groupedEntities[mGroup];
         }
         
+        const std::vector<std::unique_ptr<Entity>>& getEntities() const
+        {
+            return entities;
+        }
+        
+        std::size_t getEntityCount() const noexcept { return entities.size(); }
+        std::size_t getActiveCount() const noexcept { return active.size(); }
+        const std::vector<Entity*>& getActiveEntities() const noexcept { return active; }
+        
+        // The view of the entities with all of the components `Ts`. It is
+        // built from the current entities on first use and kept up to date
+        // from then on; the reference stays valid for the manager's life.
+        template<typename... Ts> View<TSettings, Ts...>& view()
+        {
+            using TView = View<TSettings, Ts...>;
+            auto signature(TSettings::template signature<Ts...>());
+            
+            // The same components in another order make another view.
+            for(auto& v : views)
+                if(v->signature == signature)
+                    if(auto existing = dynamic_cast<TView*>(v.get())) return *existing;
+            
+            TView* v(new TView);
+            v->signature = signature;
+            views.emplace_back(v);
+            
+            for(auto& e : entities)
+                if(e->isAlive() && e->componentBitset.contains(signature)) v->add(*e);
+            return *v;
+        }
+        
         void refresh()
         {
-            for(auto i(0u); i < maxGroups; ++i)
+            // Before the entities go away, as it reads them.
+            updateActive();
+            
+            if(!staleSinceRefresh) return;
+            staleSinceRefresh = false;
+            
+            // Views drop their dead rows before the entities go away.
+            for(auto& v : views) v->removeDead();
+            
+            for(auto i(0u); i < TSettings::groupCount; ++i)
             {
                 auto& v(groupedEntities[i]);
                 
@@ -169,31 +620,395 @@ namespace EntitySystem
                         std::end(v));
             }
             
-            entities.erase(
-                           std::remove_if(std::begin(entities), std::end(entities),
-                                          [](const std::unique_ptr<Entity>& mEntity)
-                                          {
-                                              return !mEntity->isAlive();
-                                          }),
-                           std::end(entities));
+            // Compact by hand rather than with remove_if, since dead
+            // prefab entities are moved out into their pool on the way.
+            std::size_t kept{0};
+            for(auto& e : entities)
+            {
+                if(e->isAlive())
+                {
+                    if(&entities[kept] != &e) entities[kept] = std::move(e);
+                    ++kept;
+                }
+                else if(e->prefab != noPrefab)
+                {
+                    auto& pool(pools[e->prefab]);
+                    if(pool.free.size() < pool.keep) pool.free.emplace_back(std::move(e));
+                    --pool.stats.inUse;
+                }
+            }
+            entities.erase(std::begin(entities) + kept, std::end(entities));
+        }
+        
+        // Snapshot layout: entity count (u32), then a record per alive
+        // entity as written by `serializeEntity`.
+        void serialize(SnapshotWriter& mWriter) const
+        {
+            auto countOffset(mWriter.placeholder<std::uint32_t>());
+            std::uint32_t count{0};
+            
+            for(auto& e : entities)
+            {
+                if(!e->isAlive()) continue;
+                
+                serializeEntity(*e, mWriter);
+                ++count;
+            }
+            
+            mWriter.patch(countOffset, count);
+        }
+        
+        // One entity's record: its group bits and component bits (as u64
+        // words), payload size (u32) and the component payloads in the
+        // order the components were added.
+        static void serializeEntity(const Entity& mEntity, SnapshotWriter& mWriter)
+        {
+            mEntity.getGroupBitset().serialize(mWriter);
+            mEntity.getComponentBitset().serialize(mWriter);
+            auto sizeOffset(mWriter.placeholder<std::uint32_t>());
+            auto payloadStart(mWriter.size());
+            mEntity.serialize(mWriter);
+            mWriter.patch<std::uint32_t>(sizeOffset, mWriter.size() - payloadStart);
+        }
+        
+        // Reads a record written by `serializeEntity` into a new entity
+        // made by `mFactory` for the record's groups.
+        static Entity& deserializeEntity(SnapshotReader& mReader,
+                                         const std::function<Entity&(const GroupBitset&)>& mFactory)
+        {
+            GroupBitset groups;
+            groups.deserialize(mReader);
+            return deserializeEntityInto(mReader, mFactory(groups));
+        }
+        
+        // Restores the entities written by `serialize`. When the alive
+        // entities already line up with the snapshot (the common case for
+        // rollback) their components are overwritten in place; otherwise
+        // the world is rebuilt, using `mFactory` to create an entity with
+        // the right components for each group set.
+        void deserialize(SnapshotReader& mReader,
+                         const std::function<Entity&(const GroupBitset&)>& mFactory)
+        {
+            refresh();
+            
+            auto count(mReader.read<std::uint32_t>());
+            auto recordsStart(mReader.offset());
+            
+            GroupBitset groups;
+            ComponentBitset components;
+            
+            bool inPlace{count == entities.size()};
+            for(auto i(0u); inPlace && i < count; ++i)
+            {
+                groups.deserialize(mReader);
+                components.deserialize(mReader);
+                mReader.skip(mReader.read<std::uint32_t>());
+                
+                inPlace = groups == entities[i]->getGroupBitset()
+                    && components == entities[i]->getComponentBitset();
+            }
+            mReader.seek(recordsStart);
+            
+            if(!inPlace)
+            {
+                for(auto& e : entities) e->destroy();
+                refresh();
+            }
+            
+            for(auto i(0u); i < count; ++i)
+            {
+                if(inPlace)
+                {
+                    groups.deserialize(mReader);
+                    deserializeEntityInto(mReader, *entities[i]);
+                }
+                else deserializeEntity(mReader, mFactory);
+            }
+        }
+        
+        // Moves every alive entity of `mOther` into this manager, e.g. ones
+        // built away from the game's manager on another thread. They are
+        // updated from the next refresh on.
+        void adopt(Manager& mOther)
+        {
+            for(auto& e : mOther.entities)
+            {
+                if(!e->isAlive()) continue;
+                
+                e->manager = this;
+                e->sequence = nextSequence++;
+                e->inActive = false;
+                e->changed = false;
+                noteChange(*e);
+                for(auto i(0u); i < TSettings::groupCount; ++i)
+                    if(e->groupBitset[i]) addToGroup(e.get(), i);
+                addToViews(*e);
+                entities.emplace_back(std::move(e));
+            }
+            
+            mOther.entities.clear();
+            for(auto& v : mOther.groupedEntities) v.clear();
+            for(auto& v : mOther.views) v->clear();
+            mOther.active.clear();
+            mOther.changed.clear();
         }
         
         Entity& addEntity()
         {
             Entity* e(new Entity(*this));
+            e->sequence = nextSequence++;
             std::unique_ptr<Entity> uPtr{e};
             entities.emplace_back(std::move(uPtr));
             return *e;
         }
+        
+        // Registers a prefab: `mBuild` adds the components and groups to a
+        // fresh entity, and `mReserve` entities are built up front so that
+        // spawning does not allocate until the pool runs dry. The pool
+        // keeps at most `mReserve` destroyed entities; any more are freed.
+        PrefabID registerPrefab(std::function<void(Entity&)> mBuild, std::size_t mReserve)
+        {
+            PrefabID id{pools.size()};
+            pools.emplace_back();
+            pools.back().build = std::move(mBuild);
+            pools.back().keep = mReserve;
+            pools.back().free.reserve(mReserve);
+            
+            // Pre-built entities are destroyed straight away, and the
+            // refresh moves them into the pool.
+            for(auto i(0u); i < mReserve; ++i) buildPrefab(id).destroy();
+            refresh();
+            pools[id].stats.highWater = 0;
+            
+            return id;
+        }
+        
+        // Takes an entity from the pool (or builds one if the pool is
+        // empty). Its components keep whatever state they had when it was
+        // destroyed, so the caller must reset what varies between spawns.
+        Entity& spawn(PrefabID mPrefab)
+        {
+            auto& pool(pools[mPrefab]);
+            if(pool.free.empty())
+            {
+                ++pool.stats.misses;
+                return buildPrefab(mPrefab);
+            }
+            
+            std::unique_ptr<Entity> uPtr{std::move(pool.free.back())};
+            pool.free.pop_back();
+            
+            // A recycled entity starts with a fresh update schedule.
+            Entity& e(*uPtr);
+            e.alive = true;
+            e.sleeping = false;
+            e.updateInterval = 1;
+            e.updateCounter = 0;
+            e.pendingTime = 0.f;
+            e.sequence = nextSequence++;
+            noteChange(e);
+            for(auto i(0u); i < TSettings::groupCount; ++i)
+                if(e.groupBitset[i]) addToGroup(&e, i);
+            addToViews(e);
+            
+            entities.emplace_back(std::move(uPtr));
+            countSpawn(pool);
+            return e;
+        }
+        
+        // Spawns `mCount` entities of a prefab at once. The entity list and
+        // the prefab's group lists grow once for the whole batch, pooled
+        // entities are used first and the rest are built with their
+        // component storage sized from the prefab's shape, and their
+        // components in one slab. `mInit(entity, i)` then sets what varies
+        // between them, in spawn order.
+        template<typename TInit> void spawnBatch(PrefabID mPrefab, std::size_t mCount, TInit&& mInit)
+        {
+            if(mCount == 0) return;
+            
+            auto& pool(pools[mPrefab]);
+            entities.reserve(entities.size() + mCount);
+            
+            // Build the first one on its own if that is what teaches us
+            // the prefab's shape.
+            std::size_t i{0};
+            if(!pool.shapeKnown)
+            {
+                mInit(spawn(mPrefab), i);
+                ++i;
+            }
+            
+            for(auto g(0u); g < TSettings::groupCount; ++g)
+                if(pool.groups[g]) groupedEntities[g].reserve(groupedEntities[g].size() + mCount - i);
+            
+            // The batch lets go of the slab when done (or on an exception);
+            // its components keep it alive from then on.
+            struct SlabScope
+            {
+                Manager& manager;
+                ~SlabScope()
+                {
+                    if(manager.slab != nullptr) manager.slab->release();
+                    manager.slab = nullptr;
+                }
+            } scope{*this};
+            
+            std::size_t building{mCount - i > pool.free.size() ? mCount - i - pool.free.size() : 0};
+            if(building > 0 && pool.componentBytes > 0)
+                slab = new Internal::ComponentSlab(building * pool.componentBytes);
+            
+            for(; i < mCount; ++i) mInit(spawn(mPrefab), i);
+        }
+        
+        const PoolStats& getPoolStats(PrefabID mPrefab) const
+        {
+            return pools[mPrefab].stats;
+        }
+    
+    private:
+        void noteChange(Entity& mEntity)
+        {
+            if(mEntity.changed) return;
+            mEntity.changed = true;
+            changed.emplace_back(&mEntity);
+        }
+        
+        // Applies the changes noted since the last refresh to `active`.
+        // Leaving takes one pass over it; entities spawned since are the
+        // newest, so they join at its end, and only woken ones need to be
+        // inserted in order.
+        void updateActive()
+        {
+            bool leaving{false};
+            std::size_t joining{0};
+            for(std::size_t i{0}; i < changed.size(); ++i)
+            {
+                Entity* e(changed[i]);
+                e->changed = false;
+                
+                bool wanted{e->alive && e->needsUpdate()};
+                if(wanted == e->inActive) continue;
+                
+                e->inActive = wanted;
+                if(wanted) changed[joining++] = e;
+                else leaving = true;
+            }
+            
+            if(leaving)
+                active.erase(std::remove_if(std::begin(active), std::end(active),
+                                            [](Entity* mEntity) { return !mEntity->inActive; }),
+                             std::end(active));
+            
+            auto bySequence = [](const Entity* mA, const Entity* mB) { return mA->sequence < mB->sequence; };
+            std::sort(std::begin(changed), std::begin(changed) + joining, bySequence);
+            for(std::size_t i{0}; i < joining; ++i)
+            {
+                Entity* e(changed[i]);
+                if(active.empty() || bySequence(active.back(), e)) active.emplace_back(e);
+                else active.insert(std::upper_bound(std::begin(active), std::end(active), e, bySequence), e);
+            }
+            changed.clear();
+        }
+        
+        // The rest of a record, after its group bits.
+        static Entity& deserializeEntityInto(SnapshotReader& mReader, Entity& mEntity)
+        {
+            ComponentBitset components;
+            components.deserialize(mReader);
+            auto size(mReader.read<std::uint32_t>());
+            auto payloadEnd(mReader.offset() + size);
+            
+            if(mEntity.getComponentBitset() != components)
+                throw std::runtime_error("Snapshot entity does not match the entity created for its groups.");
+            
+            mEntity.deserialize(mReader);
+            if(mReader.offset() != payloadEnd)
+                throw std::runtime_error("Snapshot entity payload has an unexpected size.");
+            return mEntity;
+        }
+        
+        Entity& buildPrefab(PrefabID mPrefab)
+        {
+            auto& pool(pools[mPrefab]);
+            Entity& e(addEntity());
+            e.prefab = mPrefab;
+            if(pool.shapeKnown)
+            {
+                e.components.reserve(pool.componentCount);
+                e.updatedComponents.reserve(pool.updatedCount);
+            }
+            
+            std::size_t bytesBefore{componentBytes};
+            pool.build(e);
+            if(!pool.shapeKnown)
+            {
+                pool.shapeKnown = true;
+                pool.componentCount = e.components.size();
+                pool.updatedCount = e.updatedComponents.size();
+                pool.componentBytes = componentBytes - bytesBefore;
+                pool.groups = e.groupBitset;
+            }
+            ++pool.stats.built;
+            countSpawn(pool);
+            return e;
+        }
+        
+        void countSpawn(Pool& mPool)
+        {
+            ++mPool.stats.inUse;
+            mPool.stats.highWater = std::max(mPool.stats.highWater, mPool.stats.inUse);
+        }
+        
+        // Adds an entity to every view it matches.
+        void addToViews(Entity& mEntity)
+        {
+            for(auto& v : views)
+                if(mEntity.componentBitset.contains(v->signature)) v->add(mEntity);
+        }
+        
+        // Adds an entity that just got component `mAdded` to the views
+        // that it matches only now.
+        void addToViews(Entity& mEntity, ComponentID mAdded)
+        {
+            for(auto& v : views)
+                if(v->signature[mAdded] && mEntity.componentBitset.contains(v->signature)) v->add(mEntity);
+        }
     };
     
-    void Entity::addGroup(Group mGroup) noexcept
+    template<typename TSettings> void Entity<TSettings>::destroy()
+    {
+        if(!alive) return;
+        for(auto& c : components) c->destroyed();
+        alive = false;
+        manager->staleSinceRefresh = true;
+        manager->noteChange(*this);
+    }
+    
+    template<typename TSettings> void Entity<TSettings>::sleep()
+    {
+        if(sleeping) return;
+        sleeping = true;
+        manager->noteChange(*this);
+    }
+    
+    template<typename TSettings> void Entity<TSettings>::wake()
     {
-        groupBitset[mGroup] = true;
-        manager.addToGroup(this, mGroup);
+        if(!sleeping) return;
+        sleeping = false;
+        manager->noteChange(*this);
+    }
+    
+    template<typename TSettings> void Entity<TSettings>::addGroup(Group mGroup) noexcept
+    {
+        groupBitset.set(mGroup);
+        manager->addToGroup(this, mGroup);
+    }
+    
+    template<typename TSettings> void Entity<TSettings>::delGroup(Group mGroup) noexcept
+    {
+        groupBitset.set(mGroup, false);
+        manager->staleSinceRefresh = true;
     }
 } // namespace EntitySystem
 
 #endif // #ifndef ENTITYSYSTEM_H
-    
-    
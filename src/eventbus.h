@@ -0,0 +1,46 @@
+#ifndef BlackHole_eventbus_h
+#define BlackHole_eventbus_h
+
+#include <tuple>
+#include <vector>
+
+// Gameplay events are appended to one contiguous queue per event type while
+// the world is updated, then handled in batches at a fixed point of the
+// tick. The code detecting an event has no side effects of its own, and a
+// handler sees every event of its type at once (so it can drop duplicates).
+//
+// The queues are cleared, not freed, so a running game does not allocate.
+template<typename... TEvents>
+class EventBus {
+public:
+    template<typename T> void emit(const T& event) {
+        queue<T>().push_back(event);
+    }
+
+    template<typename T> const std::vector<T>& events() const {
+        return std::get<std::vector<T>>(mQueues);
+    }
+
+    // Handlers may reorder (or edit) the queued events before using them.
+    template<typename T> std::vector<T>& events() {
+        return queue<T>();
+    }
+
+    template<typename T> void clear() {
+        queue<T>().clear();
+    }
+
+    void clear() {
+        using expand = int[];
+        (void)expand{0, (queue<TEvents>().clear(), 0)...};
+    }
+
+private:
+    template<typename T> std::vector<T>& queue() {
+        return std::get<std::vector<T>>(mQueues);
+    }
+
+    std::tuple<std::vector<TEvents>...> mQueues;
+};
+
+#endif
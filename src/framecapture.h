@@ -0,0 +1,236 @@
+#ifndef BlackHole_framecapture_h
+#define BlackHole_framecapture_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "alloctracker.h"
+
+// Capture file layout (native byte order, like snapshots):
+//   header: "BHCP", version (u32), width (u32), height (u32)
+//   one record per captured frame: frame number (u32), time in ms (u32),
+//   size (u32), then the frame's ARGB pixels, run-length encoded.
+// Frame numbers count every frame offered, so dropped frames show as gaps.
+//
+// The encoding is PackBits over whole pixels: a control byte c < 128 is
+// followed by c + 1 literal pixels, and c >= 128 by one pixel repeated
+// c - 126 times.
+namespace FrameCaptureFormat {
+    const char kMagic[4] = {'B', 'H', 'C', 'P'};
+    const Uint32 kVersion = 1;
+
+    inline void putPixel(std::vector<Uint8>& out, Uint32 pixel) {
+        Uint8 bytes[sizeof(pixel)];
+        std::memcpy(bytes, &pixel, sizeof(pixel));
+        out.insert(out.end(), bytes, bytes + sizeof(pixel));
+    }
+
+    inline void encode(const Uint32* pixels, std::size_t count, std::vector<Uint8>& out) {
+        out.clear();
+        std::size_t i = 0;
+        while (i < count) {
+            std::size_t run = 1;
+            while (i + run < count && run < 129 && pixels[i + run] == pixels[i]) ++run;
+
+            if (run >= 2) {
+                out.push_back(static_cast<Uint8>(run + 126));
+                putPixel(out, pixels[i]);
+                i += run;
+                continue;
+            }
+
+            // Literals up to the next run of two or more.
+            std::size_t literals = 1;
+            while (i + literals < count && literals < 128
+                   && !(i + literals + 1 < count && pixels[i + literals] == pixels[i + literals + 1])) {
+                ++literals;
+            }
+            out.push_back(static_cast<Uint8>(literals - 1));
+            for (std::size_t p = 0; p < literals; ++p) putPixel(out, pixels[i + p]);
+            i += literals;
+        }
+    }
+
+    // Returns false if the data does not decode to exactly `count` pixels.
+    inline bool decode(const Uint8* data, std::size_t size, Uint32* pixels, std::size_t count) {
+        std::size_t in = 0, outCount = 0;
+        while (in < size) {
+            Uint8 control = data[in++];
+            std::size_t n = control < 128 ? control + 1 : control - 126;
+            std::size_t bytes = control < 128 ? n * sizeof(Uint32) : sizeof(Uint32);
+            if (in + bytes > size || outCount + n > count) return false;
+
+            for (std::size_t p = 0; p < n; ++p) {
+                std::memcpy(&pixels[outCount + p], &data[in + (control < 128 ? p * sizeof(Uint32) : 0)], sizeof(Uint32));
+            }
+            in += bytes;
+            outCount += n;
+        }
+        return outCount == count;
+    }
+}
+
+// Usage counters of a frame capture.
+struct FrameCaptureStats {
+    Uint32 offered{0};          // frames the game loop tried to capture
+    Uint32 written{0};          // frames written to the file
+    Uint32 dropped{0};          // frames skipped because every slot was busy
+    Uint64 rawBytes{0};         // pixel bytes of the written frames
+    Uint64 fileBytes{0};        // bytes of their records
+    double mainThreadSeconds{0.0};  // time spent in capture() by the game loop
+};
+
+// Records the frames the renderer draws without making the game loop wait
+// for the disk. capture() copies the frame into a free slot of a ring of
+// preallocated buffers and returns; a background thread encodes the slots
+// in order and writes them out. When the writer falls behind and no slot
+// is free, the frame is dropped and counted instead.
+class FrameCapture {
+public:
+    FrameCapture(const std::string& filename, int width, int height, std::size_t slots)
+    : mFile(filename.c_str(), std::ios::binary | std::ios::trunc),
+    mWidth(width), mHeight(height), mSlots(std::max<std::size_t>(slots, 1))
+    {
+        if (!mFile) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to open capture file for writing (" << filename << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        mFile.write(FrameCaptureFormat::kMagic, 4);
+        for (Uint32 value : {FrameCaptureFormat::kVersion, Uint32(width), Uint32(height)}) {
+            mFile.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        for (auto& slot : mSlots) slot.pixels.resize(width * height);
+        mEncoded.reserve(width * height * (sizeof(Uint32) + 1));
+
+        mThread = std::thread(&FrameCapture::writerLoop, this);
+    }
+
+    ~FrameCapture() {
+        finish();
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Grabs the frame the renderer holds; call before presenting it.
+    void capture(SDL_Renderer* renderer) {
+        if (mStopping) return;
+
+        auto start(std::chrono::high_resolution_clock::now());
+        Uint32 frame = mStats.offered++;
+
+        std::size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mFilled == mSlots.size()) {
+                ++mStats.dropped;
+                mStats.mainThreadSeconds += secondsSince(start);
+                return;
+            }
+            index = (mNext + mFilled) % mSlots.size();
+        }
+
+        // The writer only looks at filled slots, so this one is ours.
+        Slot& slot(mSlots[index]);
+        slot.frame = frame;
+        slot.time = SDL_GetTicks();
+        SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, slot.pixels.data(), mWidth * sizeof(Uint32));
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mFilled;
+        }
+        mWake.notify_one();
+        mStats.mainThreadSeconds += secondsSince(start);
+    }
+
+    // Writes out the frames still waiting and stops the writer. Nothing
+    // is captured after this.
+    void finish() {
+        if (!mThread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_one();
+        mThread.join();
+        mFile.flush();
+    }
+
+    FrameCaptureStats stats() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        FrameCaptureStats stats(mStats);
+        stats.written = mWritten;
+        stats.rawBytes = mRawBytes;
+        stats.fileBytes = mFileBytes;
+        return stats;
+    }
+
+private:
+    struct Slot {
+        std::vector<Uint32> pixels;
+        Uint32 frame{0};
+        Uint32 time{0};
+    };
+
+    static double secondsSince(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void writerLoop() {
+        AllocTracker::Scope tag(AllocTracker::TAG_CAPTURE);
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWake.wait(lock, [this] { return mStopping || mFilled > 0; });
+            if (mFilled == 0) return;   // stopping, and nothing left
+
+            Slot& slot(mSlots[mNext]);
+            lock.unlock();
+
+            FrameCaptureFormat::encode(slot.pixels.data(), slot.pixels.size(), mEncoded);
+            Uint32 header[3] = { slot.frame, slot.time, static_cast<Uint32>(mEncoded.size()) };
+            mFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+            mFile.write(reinterpret_cast<const char*>(mEncoded.data()), mEncoded.size());
+
+            lock.lock();
+            mNext = (mNext + 1) % mSlots.size();
+            --mFilled;
+            ++mWritten;
+            mRawBytes += slot.pixels.size() * sizeof(Uint32);
+            mFileBytes += sizeof(header) + mEncoded.size();
+        }
+    }
+
+    std::ofstream mFile;
+    int mWidth, mHeight;
+    std::vector<Slot> mSlots;
+    std::vector<Uint8> mEncoded;    // writer thread only
+    FrameCaptureStats mStats;       // game loop only, apart from stats()
+
+    // Slots mNext .. mNext + mFilled - 1 (wrapping) wait for the writer.
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+    std::size_t mNext{0};
+    std::size_t mFilled{0};
+    Uint32 mWritten{0};
+    Uint64 mRawBytes{0};
+    Uint64 mFileBytes{0};
+    bool mStopping{false};
+
+    std::thread mThread;
+};
+
+#endif
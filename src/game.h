@@ -5,6 +5,12 @@
 // http://stackoverflow.com/questions/22368202/xcode-5-crashes-when-running-an-app-with-sdl-2
 
 #include "entitysystem.h"
+#include "aipilots.h"
+#include "alloctracker.h"
+#include "animationtimelines.h"
+#include "camera.h"
+#include "chunkstore.h"
+#include "collisionmask.h"
 #include "renderer.h"
 #include "window.h"
 #include "sprite.h"
@@ -14,7 +20,24 @@
 #include <random>
 #include <utility>
 #include "soundsystem.h"
+#include "eventbus.h"
+#include "framecapture.h"
+#include "kinematics.h"
+#include "latencytrace.h"
+#include "lensing.h"
+#include "lockstep.h"
+#include "particlesystem.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "timerwheel.h"
+#include "trajectory.h"
 #include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
 
 class Vector2f {
 public:
@@ -22,19 +45,152 @@ public:
     float x, y;
 };
 
+// Settings chosen on the command line for a game session.
+struct GameOptions {
+    // Record the seed and per-tick input to this file.
+    std::string recordFile;
+    
+    // Play back (and verify) a previously recorded session.
+    std::string replayFile;
+    
+    // Start from the latest snapshot in this checkpoint file.
+    std::string loadFile;
+    
+    // Append a snapshot to this checkpoint file every checkpointInterval ticks.
+    std::string checkpointFile;
+    unsigned checkpointInterval{600};
+    
+    // Fixed simulation rate. Rendering interpolates between ticks, and
+    // collisions are swept, so rates down to ~20 Hz play the same.
+    Uint32 ticksPerSecond{60};
+    
+    // Approximate math in the kinematics pass. Replays and the other
+    // player must use the same setting.
+    bool fastMath{false};
+    
+    // Test torpedo hits against the pixels of the sprites, not just their
+    // boxes. Replays and the other player must use the same setting.
+    bool pixelCollisions{false};
+    
+    // Allocation tracking (needs a build with BLACKHOLE_TRACK_ALLOCATIONS):
+    // print per-subsystem allocations at exit, decide what an allocation
+    // inside a steady-state tick does, or run the scripted allocation test.
+    bool allocReport{false};
+    AllocTracker::HotPolicy allocHotPolicy{AllocTracker::HotPolicy::Ignore};
+    bool allocTest{false};
+    
+    // Check that torpedo lifetimes survive the prefab pool.
+    bool timerTest{false};
+    
+    // Pre-render rotated sprites at this many angles (0 = rotate on every
+    // draw), or compare both ways with the sprite benchmark.
+    int rotationSteps{0};
+    bool spriteBenchmark{false};
+    
+    // Draw the black hole's lensing, on this many threads (0 = one per
+    // core, up to a limit), or time it with the lensing benchmark.
+    bool lensing{true};
+    unsigned lensingThreads{0};
+    bool lensingBenchmark{false};
+    
+    // Record every drawn frame to this file, in the background.
+    std::string captureFile;
+    
+    // Draw where a torpedo fired now would go.
+    bool trajectory{true};
+    
+    // AI ships pick targets, turn toward them and fire, instead of only
+    // spinning. At most aiThinkBudget of them pick a new target each tick,
+    // on aiThreads threads. Replays and the other player must use the same
+    // pilots setting and budget. The AI benchmark times a large fleet.
+    bool aiPilots{false};
+    unsigned aiThinkBudget{64};
+    unsigned aiThreads{1};
+    bool aiBenchmark{false};
+    
+    // Time spawning a large batch of asteroids.
+    bool spawnBenchmark{false};
+    
+    // Show the performance HUD from the start; F3 toggles it.
+    bool hud{false};
+    
+    // Write the input latency of every shot to this CSV file.
+    std::string latencyLog;
+    
+    // Two-player lockstep over UDP.
+    bool netPlay{false};
+    LockstepOptions net;
+};
+
 class Game {
     enum EntityGroups : std::size_t {
         EG_BLACKHOLE,
         EG_PHOTONTORPEDO,
         EG_SPACESHIP,
         EG_HUMANSPACESHIP,
-        EG_EXPLOSION,
         EG_ASTEROID,
-        EG_DESTROYABLE
+        EG_DESTROYABLE,
+        EG_COUNT
+    };
+    
+    // Every component type, in a fixed order that gives each its ID.
+    struct CPosition;
+    struct CDirection;
+    struct CLinearPhysics;
+    struct CSprite;
+    struct CSpriteAnimation;
+    struct CLifetime;
+    struct CRectangle;
+    struct CCollisionBox;
+    struct CInputAI;
+    struct CInputHuman;
+    
+    using ECSSettings = EntitySystem::Settings<
+        EntitySystem::ComponentList<CPosition, CDirection, CLinearPhysics, CSprite, CSpriteAnimation,
+                                    CLifetime, CRectangle, CCollisionBox, CInputAI, CInputHuman>,
+        EG_COUNT>;
+    using Component = EntitySystem::Component<ECSSettings>;
+    using Entity = EntitySystem::Entity<ECSSettings>;
+    using Manager = EntitySystem::Manager<ECSSettings>;
+    using Chunks = ChunkStore<Manager>;
+    
+    // A photon torpedo reaching something destroyable, `time` into the
+    // tick (0 = start, 1 = end).
+    struct CollisionEvent
+    {
+        Entity* photon;
+        Entity* target;
+        float time;
+    };
+    
+    // An entity crossing the bounds of its CLinearPhysics; `side` points
+    // back into the bounds.
+    struct OutOfBoundsEvent
+    {
+        Entity* entity;
+        Vector2f side;
+    };
+    
+    // What a timer set on the simulation's timer wheel is for.
+    enum TimerKind : Uint8 {
+        TIMER_LIFETIME      // the entity's time is up: destroy it
+    };
+    
+    // A timer expiring. Timers are not stored in snapshots or chunks; the
+    // components that set them set them again from their own state (see
+    // scheduleTimers). They cancel them when their entity is destroyed, so
+    // a timer that fires belongs to the entity's current life.
+    struct TimerEvent
+    {
+        Entity* entity;
+        TimerKind kind;
     };
     
+    using GameEvents = EventBus<CollisionEvent, OutOfBoundsEvent>;
+    using GameTimers = TimerWheel<TimerEvent>;
+    
     // Entities can have a position in the game world.
-    struct CPosition : EntitySystem::Component
+    struct CPosition : Component
     {
         Vector2f position;
     
@@ -43,9 +199,21 @@ class Game {
         
         float x() const noexcept { return position.x; }
         float y() const noexcept { return position.y; }
+        
+        void serialize(SnapshotWriter& writer) const override
+        {
+            writer.write(position.x);
+            writer.write(position.y);
+        }
+        
+        void deserialize(SnapshotReader& reader) override
+        {
+            reader.read(position.x);
+            reader.read(position.y);
+        }
     };
     
-    struct CDirection : EntitySystem::Component
+    struct CDirection : Component
     {
         float mAngle;
         
@@ -56,10 +224,13 @@ class Game {
         void setAngle( float angle ) noexcept {
             mAngle = angle;
         }
+        
+        void serialize(SnapshotWriter& writer) const override { writer.write(mAngle); }
+        void deserialize(SnapshotReader& reader) override { reader.read(mAngle); }
     };
     
     // Entities can have a physical body and a velocity.
-    struct CLinearPhysics : EntitySystem::Component
+    struct CLinearPhysics : Component
     {
         using Bound = std::pair<float,float>;
         
@@ -69,12 +240,24 @@ class Game {
         Bound mBoundX, mBoundY;
         float mSpeed;
         
-        // We will use a callback to handle the "out of bounds" event.
-        std::function<void(const Vector2f&)> onOutOfBounds;
+        // Where the body was at the start of the last tick, for swept
+        // collisions and render interpolation.
+        Vector2f mPrevious;
         
-        CLinearPhysics(const Vector2f& velocity, const Vector2f& halfSize, const Bound& boundX, const Bound& boundY)
-        : mVelocity(velocity), mHalfSize(halfSize), mBoundX(boundX), mBoundY(boundY) {
+        // Leaving the bounds is reported here, if set.
+        GameEvents* mEvents{nullptr};
+        
+        CLinearPhysics(const Vector2f& velocity, const Vector2f& halfSize, const Bound& boundX, const Bound& boundY, GameEvents* events = nullptr)
+        : mVelocity(velocity), mHalfSize(halfSize), mBoundX(boundX), mBoundY(boundY), mEvents(events) {
+            mSpeed = std::sqrt(mVelocity.x * mVelocity.x + mVelocity.y * mVelocity.y);
+        }
+        
+        // A new velocity wakes the body if it was sleeping.
+        void setVelocity(const Vector2f& velocity)
+        {
+            mVelocity = velocity;
             mSpeed = std::sqrt(mVelocity.x * mVelocity.x + mVelocity.y * mVelocity.y);
+            entity->wake();
         }
         
         void init() override
@@ -82,33 +265,38 @@ class Game {
             // A requirement for `CPhysics` is obviously `CPosition`.
             mPosition = &entity->getComponent<CPosition>();
             mDirection = &entity->getComponent<CDirection>();
+            mPrevious = mPosition->position;
         }
         
+        // The movement itself is done for all bodies at once by
+        // Game::integrateBodies; this only checks the bounds.
         void update(float ft) override
         {
-            // scale the velocity vector since it may have changed (from the blackhole)
-            float currentSpeed = std::sqrt(mVelocity.x * mVelocity.x + mVelocity.y * mVelocity.y);
-            mVelocity.x /= currentSpeed;
-            mVelocity.y /= currentSpeed;
-            
-            mVelocity.x *= mSpeed;
-            mVelocity.y *= mSpeed;
-
-            mPosition->position.x += mVelocity.x * ft;
-            mPosition->position.y += mVelocity.y * ft;
-
-            float angleRad = std::atan2(mVelocity.y, mVelocity.x);
-            float angleDeg = angleRad * 180.0 / M_PI;
-            float newAngleDeg = angleDeg + 90;
-            mDirection->setAngle( newAngleDeg );
+            if(mEvents == nullptr) return;
             
-            if(onOutOfBounds == nullptr) return;
+            if(left() < mBoundX.first) mEvents->emit(OutOfBoundsEvent{entity, Vector2f{1.f, 0.f}});
+            else if(right() > mBoundX.second) mEvents->emit(OutOfBoundsEvent{entity, Vector2f{-1.f, 0.f}});
             
-            if(left() < mBoundX.first) onOutOfBounds(Vector2f{1.f, 0.f});
-            else if(right() > mBoundX.second) onOutOfBounds(Vector2f{-1.f, 0.f});
-            
-            if(top() < mBoundY.first) onOutOfBounds(Vector2f{0.f, 1.f});
-            else if(bottom() > mBoundY.second) onOutOfBounds(Vector2f{0.f, -1.f});
+            if(top() < mBoundY.first) mEvents->emit(OutOfBoundsEvent{entity, Vector2f{0.f, 1.f}});
+            else if(bottom() > mBoundY.second) mEvents->emit(OutOfBoundsEvent{entity, Vector2f{0.f, -1.f}});
+        }
+        
+        void serialize(SnapshotWriter& writer) const override
+        {
+            writer.write(mVelocity.x);
+            writer.write(mVelocity.y);
+            writer.write(mSpeed);
+            writer.write(mPrevious.x);
+            writer.write(mPrevious.y);
+        }
+        
+        void deserialize(SnapshotReader& reader) override
+        {
+            reader.read(mVelocity.x);
+            reader.read(mVelocity.y);
+            reader.read(mSpeed);
+            reader.read(mPrevious.x);
+            reader.read(mPrevious.y);
         }
         
         float x() 		const noexcept { return mPosition->x(); }
@@ -119,19 +307,25 @@ class Game {
         float bottom() 	const noexcept { return y() + mHalfSize.y; }
     };
     
-    // An entity can be drawn with a sprite
-    struct CSprite : EntitySystem::Component
+    // An entity can be drawn with a sprite. `mRect` is in world
+    // coordinates; the camera moves it on screen when drawing.
+    struct CSprite : Component
     {
         CPosition* mPosition;
         CDirection* mDirection;
+        const Camera* mCamera;
         
         Sprite mSprite;
         SDL_Rect mRect;
         float mWidth, mHeight;
         float mAngle;
         
-        CSprite(Sprite sprite, float width, float height)
-        : mSprite(sprite), mWidth(width), mHeight(height) {
+        // Set on a traced shot until its first draw.
+        LatencyTrace* mTrace{nullptr};
+        int mTraceShot{0};
+        
+        CSprite(Sprite sprite, float width, float height, const Camera& camera)
+        : mCamera(&camera), mSprite(sprite), mWidth(width), mHeight(height) {
         }
         
         virtual ~CSprite() {
@@ -157,84 +351,167 @@ class Game {
         
         void draw() override
         {
-            mSprite.draw(mRect.x, mRect.y, mRect.w, mRect.h, mAngle);
+            SDL_Rect dest(mCamera->toScreen(mRect));
+            mSprite.draw(dest.x, dest.y, dest.w, dest.h, mAngle);
+            
+            if (mTrace) {
+                mTrace->drawn(mTraceShot);
+                mTrace = nullptr;
+            }
+        }
+        
+        // Moves the sprite to an interpolated position for the next draw.
+        void setCenter(float x, float y)
+        {
+            mRect.x = x - mWidth/2.0;
+            mRect.y = y - mHeight/2.0;
+        }
+        
+        // Nothing to store, but the cached rect must follow the restored position.
+        void deserialize(SnapshotReader& reader) override
+        {
+            update(0.0);
         }
     };
     
-    struct CSpriteAnimation : EntitySystem::Component
+    // An entity can be drawn with an animation. The clip and its clock
+    // are shared (see AnimationTimelines); the entity only keeps the tick
+    // it started playing on. Given the timers, an entity lives as long as
+    // a clip that does not loop: a timer destroys it when the clip ends.
+    struct CSpriteAnimation : Component
     {
         CPosition* mPosition;
+        const Camera* mCamera;
+        const AnimationTimelines* mTimelines;
+        GameTimers* mTimers;
         
-        std::shared_ptr<SpriteAnimation> mSpriteAnimation;
         SDL_Rect mRect;
         float mWidth, mHeight;
-        float mDuration;
-        float mTimeAlive{0.0};
-        int mCurrentFrame{0};
-        bool mKillOnLastFrame{true};
+        AnimationTimelines::TimelineID mTimeline;
+        Uint32 mStart{0};
+        GameTimers::Handle mEnd;
         
-        CSpriteAnimation(std::shared_ptr<SpriteAnimation> spriteAnimation, float width, float height, float duration, bool killOnLastFrame = true)
-        : mSpriteAnimation(spriteAnimation), mWidth(width), mHeight(height), mDuration(duration),
-        mKillOnLastFrame(killOnLastFrame) {
+        CSpriteAnimation(const AnimationTimelines& timelines, AnimationTimelines::TimelineID timeline, const Camera& camera,
+                         float width, float height, GameTimers* timers = nullptr)
+        : mCamera(&camera), mTimelines(&timelines), mTimers(timers), mWidth(width), mHeight(height), mTimeline(timeline) {
         }
         
         virtual ~CSpriteAnimation() {
+            if (mTimers) mTimers->cancel(mEnd);
+        }
+        
+        void destroyed() override
+        {
+            if (mTimers) mTimers->cancel(mEnd);
         }
         
         void init() override
         {
             mPosition = &entity->getComponent<CPosition>();
             
-            update(0.0);
+            // Not the clock: entities are also built on the chunk loader
+            // thread. Whoever spawns the entity calls play().
+            updateRect();
+        }
+        
+        // Starts the clip over from its first frame.
+        void play()
+        {
+            mStart = mTimelines->tick();
+            if (mTimers) mTimers->cancel(mEnd);
+            scheduleEnd();
+        }
+        
+        // Sets the timer for the end of the clip, unless it is set already.
+        // Not on the chunk loader thread: whoever adds the entity to the
+        // world calls this (or play()).
+        void scheduleEnd()
+        {
+            if (!mTimers || mTimelines->loops(mTimeline) || mTimers->pending(mEnd)) return;
+            mEnd = mTimers->schedule(mStart + mTimelines->length(mTimeline), TimerEvent{entity, TIMER_LIFETIME});
         }
         
         void update(float ft) override
         {
+            updateRect();
+        }
+        
+        void draw() override
+        {
+            SDL_Rect dest(mCamera->toScreen(mRect));
+            mTimelines->animation(mTimeline).draw(dest.x, dest.y, dest.w, dest.h, mTimelines->frame(mTimeline, mStart));
+        }
+        
+        void serialize(SnapshotWriter& writer) const override
+        {
+            writer.write(mStart);
+        }
+        
+        void deserialize(SnapshotReader& reader) override
+        {
+            reader.read(mStart);
+            updateRect();
+        }
+        
+    protected:
+        void updateRect() {
             mRect.x = mPosition->x() - mWidth/2.0;
             mRect.y = mPosition->y() - mHeight/2.0;
             mRect.w = mWidth;
             mRect.h = mHeight;
-            
-            
-            
-            float secs_per_frame = mDuration / (1.0f*mSpriteAnimation->numFrames());
-            if (mTimeAlive > (secs_per_frame * (mCurrentFrame))) {
-                nextFrame();
-            }
-            
-            if (mTimeAlive > mDuration) {
-                if (mKillOnLastFrame) {
-                    entity->destroy();
-                }
-                
-                // Reset the animation
-                mTimeAlive = 0.0;
-                mCurrentFrame = 0;
-            }
-            
-            mTimeAlive += ft;
+        }
+    };
+    
+    // An entity that lives until a given tick: a timer destroys it then.
+    // Only that tick is stored; the timer is set again after a restore
+    // (see scheduleTimers).
+    struct CLifetime : Component
+    {
+        GameTimers* mTimers;
+        Uint32 mEnd{0};
+        GameTimers::Handle mTimer;
+        
+        explicit CLifetime(GameTimers& timers) : mTimers(&timers) { }
+        
+        virtual ~CLifetime() {
+            mTimers->cancel(mTimer);
         }
         
-        void draw() override
+        void destroyed() override
         {
-            mSpriteAnimation->draw(mRect.x, mRect.y, mRect.w, mRect.h, mCurrentFrame);
+            mTimers->cancel(mTimer);
         }
         
-    protected:
-        //int currentFrame() const { return mCurrentFrame; }
-        void nextFrame() {
-            mCurrentFrame += 1;
-            
-            // return back to zero
-            if (mCurrentFrame >= mSpriteAnimation->numFrames() - 1) {
-                mCurrentFrame = 0;
-            }
+        // Starts a new life ending on `end`.
+        void start(Uint32 end)
+        {
+            mTimers->cancel(mTimer);
+            mEnd = end;
+            scheduleEnd();
+        }
+        
+        // Sets the timer, unless it is set already. Not on the chunk loader
+        // thread, like CSpriteAnimation::scheduleEnd.
+        void scheduleEnd()
+        {
+            if (mTimers->pending(mTimer)) return;
+            mTimer = mTimers->schedule(mEnd, TimerEvent{entity, TIMER_LIFETIME});
+        }
+        
+        void serialize(SnapshotWriter& writer) const override
+        {
+            writer.write(mEnd);
+        }
+        
+        void deserialize(SnapshotReader& reader) override
+        {
+            reader.read(mEnd);
         }
     };
     
     
     // To-do: Render the square to a texture, then display the rotated texture
-    struct CRectangle : EntitySystem::Component
+    struct CRectangle : Component
     {
         CPosition* mPosition;
         CDirection* mDirection;
@@ -268,19 +545,24 @@ class Game {
             SDL_SetRenderDrawColor( mGame->mRenderer->getRenderer(), 0, 255, 0, 255 );
             
             // Render rect
-            SDL_RenderFillRect( mGame->mRenderer->getRenderer(), &mRect );
+            SDL_Rect dest(mGame->mCamera.toScreen(mRect));
+            SDL_RenderFillRect( mGame->mRenderer->getRenderer(), &dest );
+            RenderStats::countDrawCall();
         }
     };
     
     
-    // Entities can have a physical body and a velocity.
-    struct CCollisionBox : EntitySystem::Component
+    // Entities can have a physical body and a velocity. With pixel
+    // collisions, the box is only the broadphase and `mMasks` (if set)
+    // decides.
+    struct CCollisionBox : Component
     {
         CPosition* mPosition{nullptr};
         Vector2f mHalfSize;
+        const CollisionMasks* mMasks{nullptr};
         
-        CCollisionBox(const Vector2f& halfSize)
-        : mHalfSize(halfSize) { }
+        CCollisionBox(const Vector2f& halfSize, const CollisionMasks* masks = nullptr)
+        : mHalfSize(halfSize), mMasks(masks) { }
         
         void init() override
         {
@@ -288,10 +570,6 @@ class Game {
             mPosition = &entity->getComponent<CPosition>();
         }
         
-        void update(float ft) override
-        {
-        }
-        
         float x() 		const noexcept { return mPosition->x(); }
         float y() 		const noexcept { return mPosition->y(); }
         float left() 	const noexcept { return x() - mHalfSize.x; }
@@ -302,13 +580,19 @@ class Game {
     
     
     
-    // AI will control 'input'
-    struct CInputAI : EntitySystem::Component
+    // AI will control 'input'. The ship is flown by Game::updateAI, all AI
+    // ships at once; this holds its pilot's state. The target is where the
+    // pilot last saw one, until it thinks again.
+    struct CInputAI : Component
     {
         CPosition* mPosition;
         CDirection* mDirection;
+        CSprite* mSprite;
         
-        float mAngleSpeedPerSec;
+        float mAngleSpeedPerSec;    // spin while there is no target
+        bool mHasTarget{false};
+        float mTargetX{0.0f}, mTargetY{0.0f};
+        float mCooldown{0.0f};      // seconds until it can fire again
         
         CInputAI(float angleSpeedDegPerSec = 2.0)
         : mAngleSpeedPerSec(angleSpeedDegPerSec)
@@ -319,35 +603,40 @@ class Game {
         {
             mPosition = &entity->getComponent<CPosition>();
             mDirection = &entity->getComponent<CDirection>();
+            mSprite = &entity->getComponent<CSprite>();
         }
         
-        void update(float mFT) override
+        void draw() override
         {
-            float angleChange = mAngleSpeedPerSec * mFT;
-            float oldAngle = mDirection->angle();
-            float newAngle = oldAngle + angleChange;
-            
-            if(newAngle < 0.0) {
-                while(newAngle < 0.0) newAngle += 360.0;
-            } else if (newAngle > 360.0) {
-                while (newAngle >= 360.0) newAngle -= 360.0;
-            }
-            
-            mDirection->setAngle(newAngle);
         }
         
-        void draw() override
+        void serialize(SnapshotWriter& writer) const override
+        {
+            writer.write(mAngleSpeedPerSec);
+            writer.write(mHasTarget);
+            writer.write(mTargetX);
+            writer.write(mTargetY);
+            writer.write(mCooldown);
+        }
+        
+        void deserialize(SnapshotReader& reader) override
         {
+            reader.read(mAngleSpeedPerSec);
+            reader.read(mHasTarget);
+            reader.read(mTargetX);
+            reader.read(mTargetY);
+            reader.read(mCooldown);
         }
     };
     
     
-    struct CInputHuman : EntitySystem::Component
+    struct CInputHuman : Component
     {
         Game* mGame; // needed to create a photon
         CDirection* mDirection;
         
         float mAngleSpeedPerSec;
+        int mPlayer;
         
         enum RotationDirection {
             RD_LEFT,
@@ -357,8 +646,8 @@ class Game {
         
         RotationDirection mRotation;
         
-        CInputHuman(Game* game, float angleSpeedDegPerSec = 120.0)
-        : mGame(game), mAngleSpeedPerSec(angleSpeedDegPerSec), mRotation(RD_NONE)
+        CInputHuman(Game* game, float angleSpeedDegPerSec = 120.0, int player = 0)
+        : mGame(game), mAngleSpeedPerSec(angleSpeedDegPerSec), mPlayer(player), mRotation(RD_NONE)
         {
         }
         
@@ -371,34 +660,23 @@ class Game {
             float angleChange = mAngleSpeedPerSec * mFT;
             mRotation = RD_NONE;
             
-            SDL_Event e;
-            while (SDL_PollEvent(&e)) {
-                if (e.type == SDL_QUIT) {
-                    mGame->mIsRunning = false;
-                    return;
-                }
-                else if( e.type == SDL_KEYDOWN )
-                {
-                    //Select surfaces based on key press
-                    switch( e.key.keysym.sym )
-                    {
-                        case SDLK_UP:
-                            auto& position(entity->getComponent<CPosition>());
-                            auto& direction(entity->getComponent<CDirection>());
-                            mGame->createPhotonTorpedo(position.x(), position.y(), direction.angle());
-                            mGame->mSoundSystem->playFire();
-                            break;
-                    }
-                }
+            // The input for this tick was sampled (or read back from a
+            // replay) by Game::handleInput before the update.
+            const InputFrame& input = mGame->mPlayerInputs[mPlayer];
+            
+            for (int i = 0; i < input.fireCount(); i++) {
+                auto& position(entity->getComponent<CPosition>());
+                auto& direction(entity->getComponent<CDirection>());
+                auto& torpedo(mGame->createPhotonTorpedo(position.x(), position.y(), direction.angle()));
+                mGame->traceShot(torpedo, mPlayer);
+                if (!mGame->mResimulating) mGame->mSoundSystem->playFire();
             }
             
-            const Uint8* currentKeyStates = SDL_GetKeyboardState( NULL );
- 
-            if( currentKeyStates[ SDL_SCANCODE_LEFT ] )
+            if( input.left() )
             {
                 mRotation = RD_LEFT;
             }
-            else if( currentKeyStates[ SDL_SCANCODE_RIGHT ] )
+            else if( input.right() )
             {
                 mRotation = RD_RIGHT;
             }
@@ -407,16 +685,11 @@ class Game {
             else if (mRotation == RD_NONE) angleChange = 0.0;
             
             float oldAngle = mDirection->angle();
-            float newAngle = oldAngle + angleChange;
-            
-            if(newAngle < 0.0) {
-                while(newAngle < 0.0) newAngle += 360.0;
-            } else if (newAngle > 360.0) {
-                while (newAngle >= 360.0) newAngle -= 360.0;
-            }
-            
-            mDirection->setAngle(newAngle);
+            mDirection->setAngle(Kinematics::wrapDegrees(oldAngle + angleChange));
         }
+        
+        void serialize(SnapshotWriter& writer) const override { writer.write(mPlayer); }
+        void deserialize(SnapshotReader& reader) override { reader.read(mPlayer); }
     };
     
     // This only works with intersecting rectangles
@@ -426,8 +699,91 @@ class Game {
         && mA.bottom() >= mB.top() && mA.top() <= mB.bottom();
     }
     
+    // Swept version of isIntersecting: the boxes are where they are at the
+    // end of the tick and moved by mMotionA and mMotionB during it. Returns
+    // whether they touched at any point in the tick, and if so when first
+    // (mTime) and last (mExitTime).
+    bool isSweptIntersecting(const CCollisionBox& mA, const Vector2f& mMotionA,
+                             const CCollisionBox& mB, const Vector2f& mMotionB,
+                             float& mTime, float& mExitTime) noexcept
+    {
+        // In B's frame, the centre of A moves along a segment against B
+        // grown by A's half size (slab test).
+        float halfSize[2] = { mA.mHalfSize.x + mB.mHalfSize.x, mA.mHalfSize.y + mB.mHalfSize.y };
+        float motion[2] = { mMotionA.x - mMotionB.x, mMotionA.y - mMotionB.y };
+        float start[2] = { mA.x() - mB.x() - motion[0], mA.y() - mB.y() - motion[1] };
+        
+        float enter = 0.0f, exit = 1.0f;
+        for (int axis = 0; axis < 2; axis++) {
+            if (motion[axis] == 0.0f) {
+                if (std::fabs(start[axis]) > halfSize[axis]) return false;
+                continue;
+            }
+            
+            float t1 = (-halfSize[axis] - start[axis]) / motion[axis];
+            float t2 = (halfSize[axis] - start[axis]) / motion[axis];
+            enter = std::max(enter, std::min(t1, t2));
+            exit = std::min(exit, std::max(t1, t2));
+            if (enter > exit) return false;
+        }
+        
+        mTime = enter;
+        mExitTime = exit;
+        return true;
+    }
+    
+    // Narrowphase for two entities whose boxes touch from mTime to
+    // mExitTime into the tick: steps through that part of the tick about a
+    // pixel of relative motion at a time and tests their masks, moving
+    // mTime to the first step where they overlap. Entities without masks
+    // keep the result of the boxes.
+    bool isPixelIntersecting(const Entity& mA, const Vector2f& mMotionA,
+                             const Entity& mB, const Vector2f& mMotionB, float& mTime, float mExitTime) const noexcept
+    {
+        const CollisionMask* maskA = maskOf(mA);
+        const CollisionMask* maskB = maskOf(mB);
+        if (maskA == nullptr || maskB == nullptr) return true;
+        
+        // The masks are centered on the positions, which are where the
+        // entities end the tick.
+        auto& pa(mA.getComponent<CPosition>());
+        auto& pb(mB.getComponent<CPosition>());
+        float offsetX = pa.x() - maskA->width() / 2.0f - (pb.x() - maskB->width() / 2.0f);
+        float offsetY = pa.y() - maskA->height() / 2.0f - (pb.y() - maskB->height() / 2.0f);
+        Vector2f motion{mMotionA.x - mMotionB.x, mMotionA.y - mMotionB.y};
+        
+        float distance = std::sqrt(motion.x * motion.x + motion.y * motion.y) * (mExitTime - mTime);
+        int samples = 1 + static_cast<int>(std::ceil(distance));
+        if (samples > MASK_MAX_SAMPLES) samples = MASK_MAX_SAMPLES;
+        for (int i = 0; i < samples; i++) {
+            float time = samples == 1 ? mTime : mTime + (mExitTime - mTime) * i / (samples - 1);
+            int dx = static_cast<int>(std::floor(offsetX - motion.x * (1.0f - time) + 0.5f));
+            int dy = static_cast<int>(std::floor(offsetY - motion.y * (1.0f - time) + 0.5f));
+            
+            if (maskA->overlaps(*maskB, dx, dy)) {
+                mTime = time;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // The mask for how an entity is drawn right now: its animation frame,
+    // or else its rotation. Null if it has no masks.
+    const CollisionMask* maskOf(const Entity& entity) const noexcept
+    {
+        const CollisionMasks* masks = entity.getComponent<CCollisionBox>().mMasks;
+        if (masks == nullptr) return nullptr;
+        
+        if (entity.hasComponent<CSpriteAnimation>()) {
+            auto& animation(entity.getComponent<CSpriteAnimation>());
+            return &masks->forFrame(mAnimations.frame(animation.mTimeline, animation.mStart));
+        }
+        return &masks->forAngle(entity.getComponent<CDirection>().angle());
+    }
+    
 public:
-    Game() {
+    Game(const GameOptions& options = GameOptions()) {
         SDL_Init (SDL_INIT_EVERYTHING);
         
         // load support for the JPG and PNG image formats
@@ -447,37 +803,186 @@ public:
         mBackground = mRenderer->createTexture("../data/background.bmp");
         mExplosionAnimation = mRenderer->createSpriteAnimation("../data/explode_3.png", 4, 4);
         mAsteroidAnimation = mRenderer->createSpriteAnimation("../data/asteroid1.png", 5, 4);
+        
+        mPlayerSprite.reset(new Sprite(mSpaceshipBlue->createSprite(22, 46, 700, 900)));
+        mAISpaceshipSprite.reset(new Sprite(mSpaceshipSS->createSprite(840, 0, 610, 530)));
+        mTorpedoSprite.reset(new Sprite(mPhotonSS->createSprite(0, 0, 28, 86)));
+        if (options.rotationSteps > 0) {
+            // At the sizes the build functions draw them.
+            mPlayerSprite->cacheRotations(20, 25, options.rotationSteps);
+            mAISpaceshipSprite->cacheRotations(20, 20, options.rotationSteps);
+            mTorpedoSprite->cacheRotations(4, 12, options.rotationSteps);
+        }
+        
+        if (options.lensing || options.lensingBenchmark) {
+            mLensing.reset(new LensingEffect(mWindowWidth, mWindowHeight, lensingThreads(options)));
+            mLensing->setLens(LENSING_RADIUS, LENSING_HORIZON, LENSING_STRENGTH);
+        }
+        
+        mHud.reset(new TextBatch(mRenderer->createFont()));
+        mHud->reserve(HUD_TEXT_SIZE);
+        mHudVisible = options.hud;
+        
+        mPixelCollisions = options.pixelCollisions;
+        
+        mAIPilots = options.aiPilots || options.aiBenchmark;
+        mAIThinkBudget = std::max(1u, options.aiThinkBudget);
+        mAI.reset(new AIPilots(options.aiThreads));
+        if (mPixelCollisions) {
+            mAISpaceshipMasks.reset(new CollisionMasks(CollisionMasks::rotated(*mAISpaceshipSprite, 20, 20, MASK_ROTATION_STEPS)));
+            mTorpedoMasks.reset(new CollisionMasks(CollisionMasks::rotated(*mTorpedoSprite, 4, 12, MASK_ROTATION_STEPS)));
+            mAsteroidMasks.reset(new CollisionMasks(CollisionMasks::animated(*mAsteroidAnimation, 40, 40)));
+        }
+        
+        mExplosionStyle = mParticles.addStyle({mExplosionAnimation, 60, 60, 2.0f});
+        mDebrisStyle = mParticles.addStyle({mAsteroidAnimation, 6, 6, 1.0f});
+        mExhaustStyle = mParticles.addStyle({mExplosionAnimation, 6, 6, 0.4f});
+        
+        mTorpedoPrefab = mManager.registerPrefab([this](Entity& entity) {
+            buildPhotonTorpedo(entity);
+        }, TORPEDO_POOL_SIZE);
+        // Every torpedo in flight holds a lifetime timer.
+        mTimers.reserve(TORPEDO_POOL_SIZE);
+        
+        // The world is spawned in bulk below, so these keep no reserve.
+        mAISpaceshipPrefab = mManager.registerPrefab([this](Entity& entity) {
+            buildAISpaceship(entity);
+        }, 0);
+        mAsteroidPrefab = mManager.registerPrefab([this](Entity& entity) {
+            buildAsteroid(entity);
+        }, 0);
+        
+        mChunks.reset(new Chunks(mWorldWidth, mWorldHeight, CHUNK_SIZE,
+                                 [this](Manager& staging, const Entity::GroupBitset& groups) -> Entity& {
+            return createFrozenEntity(staging, groups);
+        }));
 
-        createHumanSpaceship();
+        if (options.netPlay) {
+            if (!options.replayFile.empty() || !options.recordFile.empty() || !options.loadFile.empty()) {
+                throw std::runtime_error("Two-player games cannot be recorded, replayed or loaded.");
+            }
+            
+            // Both peers must spawn the same world; the host picks the seed.
+            std::random_device rd;
+            LockstepOptions net(options.net);
+            net.ticksPerSecond = options.ticksPerSecond;
+            mLockstep.reset(new LockstepSession(net));
+            std::cout << "Waiting for the other player..." << std::endl;
+            mSeed = mLockstep->connect(rd(), NET_CONNECT_TIMEOUT_MS);
+            mTicksPerSecond = mLockstep->ticksPerSecond();
+        } else if (!options.replayFile.empty()) {
+            // A replay must spawn the exact same world, so it brings its own seed.
+            mReplayPlayer.reset(new ReplayPlayer(options.replayFile));
+            mSeed = mReplayPlayer->seed();
+            mTicksPerSecond = mReplayPlayer->ticksPerSecond();
+        } else if (options.allocTest || options.timerTest) {
+            // The scripted tests always play the same world.
+            mSeed = ALLOC_TEST_SEED;
+            mTicksPerSecond = options.ticksPerSecond;
+        } else {
+            // Seed with a real random value, if available
+            std::random_device rd;
+            mSeed = rd();
+            mTicksPerSecond = options.ticksPerSecond;
+        }
+        
+        if (mTicksPerSecond < MIN_TICKS_PER_SECOND || mTicksPerSecond > MAX_TICKS_PER_SECOND) {
+            std::ostringstream oss;
+            oss << "Unsupported tick rate (" << mTicksPerSecond << " Hz)";
+            throw std::runtime_error(oss.str());
+        }
+        
+        mPrecision = options.fastMath ? Kinematics::Precision::Fast : Kinematics::Precision::Exact;
+        
+        // Every asteroid loops the same two second clip.
+        mAsteroidTimeline = mAnimations.add(mAsteroidAnimation, 2.0f, mTicksPerSecond, true);
+        
+        if (options.trajectory) {
+            // The torpedo's center stays where CLinearPhysics keeps its box.
+            TrajectoryWorld world{
+                mWorldWidth / 2.0f, mWorldHeight / 2.0f, BLACK_HOLE_ATTRACTION,
+                TORPEDO_BOUNDS_MARGIN + TORPEDO_HALF_WIDTH, TORPEDO_BOUNDS_MARGIN + TORPEDO_HALF_HEIGHT,
+                mWorldWidth - TORPEDO_BOUNDS_MARGIN - TORPEDO_HALF_WIDTH, mWorldHeight - TORPEDO_BOUNDS_MARGIN - TORPEDO_HALF_HEIGHT,
+                1.0f / mTicksPerSecond, TORPEDO_SPEED,
+                static_cast<int>(std::lround(TRAJECTORY_SECONDS * mTicksPerSecond))
+            };
+            mTrajectory.reset(new TrajectoryPreview(world, TRAJECTORY_LANE_SPACING));
+        }
+        
+        mAllocReport = options.allocReport;
+        mAllocHotPolicy = options.allocHotPolicy;
+        AllocTracker::setHotPolicy(mAllocHotPolicy);
+        
+        if (!options.recordFile.empty()) {
+            mReplayRecorder.reset(new ReplayRecorder(options.recordFile, mSeed, mTicksPerSecond));
+        }
+        
+        createHumanSpaceship(0);
+        if (mLockstep) {
+            createHumanSpaceship(1);
+        }
         
         // For fun, create a bunch of random AI controlled spaceships
         {
-            // Seed with a real random value, if available
-            std::random_device rd;
-            
             // Choose a random mean between 1 and 6
-            std::default_random_engine e1(rd());
-            std::uniform_int_distribution<int> randomX(80, mWindowWidth-80);
-            std::uniform_int_distribution<int> randomY(80, mWindowHeight-80);
+            std::default_random_engine e1(mSeed);
+            std::uniform_int_distribution<int> randomX(80, mWorldWidth-80);
+            std::uniform_int_distribution<int> randomY(80, mWorldHeight-80);
             
-            std::mt19937 gen(rd());
+            std::mt19937 gen(mSeed);
             std::uniform_real_distribution<> randomRotationSpeed(-359.0, 359.0);
 
             // Create random spaceships
-            for (int i = 0; i < 25; i++) {
+            mManager.spawnBatch(mAISpaceshipPrefab, WORLD_POPULATION, [&](Entity& entity, std::size_t) {
                 int posX = randomX(e1);
                 int posY = randomY(e1);
                 double rotationSpeed = randomRotationSpeed(gen);
-                createAISpaceship( posX, posY, rotationSpeed );
-            }
+                placeAISpaceship( entity, posX, posY, rotationSpeed );
+            });
             
             // Create random asteroids
-            for (int i = 0; i < 25; i++) {
+            mManager.spawnBatch(mAsteroidPrefab, WORLD_POPULATION, [&](Entity& entity, std::size_t) {
                 int posX = randomX(e1);
                 int posY = randomY(e1);
                 //double rotationP = randomRotationSpeed(gen);
-                createAsteroid( posX, posY );
+                placeAsteroid( entity, posX, posY );
+            });
+        }
+        
+        // The views, and the batches built from them each tick, keep room
+        // for the whole world and a full torpedo pool, so they do not grow
+        // as chunks are paged in and out.
+        std::size_t rows = mManager.getEntityCount() + TORPEDO_POOL_SIZE;
+        mManager.view<CPosition, CLinearPhysics>().reserve(rows);
+        mManager.view<CPosition, CDirection, CLinearPhysics>().reserve(rows);
+        mManager.view<CPosition, CDirection, CInputAI>().reserve(rows);
+        mManager.view<CSpriteAnimation>().reserve(rows);
+        mManager.view<CLifetime>().reserve(rows);
+        mBodies.reserve(rows);
+        mKinematics.reserve(rows);
+        mAIActors.reserve(rows);
+        
+        // Only what the players can see stays live.
+        streamChunks();
+        
+        if (!options.loadFile.empty()) {
+            if (mReplayRecorder || mReplayPlayer) {
+                throw std::runtime_error("A snapshot cannot be loaded while recording or replaying.");
             }
+            loadSnapshot(loadLatestCheckpoint(options.loadFile));
+        }
+        
+        if (!options.latencyLog.empty()) {
+            mLatency.openLog(options.latencyLog);
+        }
+        
+        if (!options.captureFile.empty()) {
+            mCapture.reset(new FrameCapture(options.captureFile, mWindowWidth, mWindowHeight, FRAME_CAPTURE_SLOTS));
+        }
+        
+        if (!options.checkpointFile.empty()) {
+            mCheckpointWriter.reset(new CheckpointWriter(options.checkpointFile));
+            mCheckpointInterval = std::max(1u, options.checkpointInterval);
         }
         
         mIsRunning = false;
@@ -486,6 +991,9 @@ public:
     }
     
     ~Game() {
+        // Stop the chunk loader first; it builds entities with our resources.
+        mChunks.reset();
+        
         delete mRenderer;
         delete mWindow;
         delete mSoundSystem;
@@ -499,219 +1007,1667 @@ public:
         gameLoop();
     }
     
-    Window* getWindow();
-    Renderer* getRenderer();
+    // Scripted scenario for --alloc-test: the first player turns and fires
+    // on a fixed pattern. The first ALLOC_TEST_WARMUP_TICKS fill the
+    // torpedo pool and grow every buffer to its working size; after that,
+    // ticks must not allocate, and no chunk may be paged in or out: the
+    // torpedoes must not pile up in frozen chunks. Returns the process exit
+    // code.
+    int runAllocationTest ()
+    {
+        if (!AllocTracker::kEnabled) {
+            std::cerr << "The allocation test needs a build with BLACKHOLE_TRACK_ALLOCATIONS defined." << std::endl;
+            return 2;
+        }
+        
+        const float seconds = 1.0f / mTicksPerSecond;
+        auto step = [this, seconds]() {
+            InputFrame input;
+            Uint32 phase = (mTick / 90) % 3;
+            input.setLeft(phase == 0);
+            input.setRight(phase == 1);
+            if (mTick % 12 == 0) input.addFire();
+            
+            mPlayerInputs[0] = input;
+            simulateTick(seconds);
+            draw(1.0f);
+        };
+        
+        // Growing to the working size is allowed during the warm-up.
+        AllocTracker::setHotPolicy(AllocTracker::HotPolicy::Ignore);
+        for (Uint32 i = 0; i < ALLOC_TEST_WARMUP_TICKS; i++) step();
+        AllocTracker::setHotPolicy(mAllocHotPolicy);
+        
+        AllocTracker::takeFrame();
+        std::uint64_t violationsBefore = AllocTracker::hotViolations();
+        ChunkStats chunksBefore(mChunks->stats());
+        for (Uint32 i = 0; i < ALLOC_TEST_TICKS; i++) step();
+        AllocTracker::Frame steady(AllocTracker::takeFrame());
+        std::uint64_t violations = AllocTracker::hotViolations() - violationsBefore;
+        ChunkStats chunks(mChunks->stats());
+        
+        std::cout << "Allocations in " << ALLOC_TEST_TICKS << " steady-state ticks:" << std::endl;
+        printAllocations(steady, 1);
+        
+        if (violations != 0) {
+            std::cout << "FAILED: " << violations << " allocations inside ticks" << std::endl;
+            return 1;
+        }
+        std::size_t pagedOut = chunks.pagedOut - chunksBefore.pagedOut;
+        std::size_t pagedIn = chunks.pagedIn - chunksBefore.pagedIn;
+        const AllocTracker::Counts& streaming(steady.tags[AllocTracker::TAG_STREAMING]);
+        if (pagedOut != 0 || pagedIn != 0 || streaming.allocations != 0) {
+            std::cout << "FAILED: chunk streaming paged out " << pagedOut << " and paged in " << pagedIn
+                      << " entities, " << streaming.allocations << " allocations (" << streaming.bytes
+                      << " bytes)" << std::endl;
+            return 1;
+        }
+        std::cout << "PASSED: ticks did not allocate" << std::endl;
+        return 0;
+    }
     
-protected:
-    // See the "Game Update" pattern
-    // http://gameprogrammingpatterns.com/game-loop.html
-    void gameLoop ()
+    // Scripted scenario for --timer-test: the first player fires, the
+    // torpedo is destroyed before its lifetime ends, and the player fires
+    // again on the tick its timer was due. The pool hands the same torpedo
+    // out again, and the timer of its old life must not end the new one.
+    // Returns the process exit code.
+    int runTimerTest ()
     {
-        using FrameTime = float;
+        const float seconds = 1.0f / mTicksPerSecond;
+        auto step = [this, seconds](bool fire) {
+            InputFrame input;
+            if (fire) input.addFire();
+            mPlayerInputs[0] = input;
+            simulateTick(seconds);
+        };
+        // The last one fired, alive or not (the group drops it at the next
+        // refresh).
+        auto torpedo = [this]() -> Entity* {
+            auto& torpedoes(mManager.getEntitiesByGroup(EG_PHOTONTORPEDO));
+            return torpedoes.empty() ? nullptr : torpedoes.back();
+        };
         
-        mIsRunning = true;
+        step(true);
+        Entity* first = torpedo();
+        if (first == nullptr) {
+            std::cout << "FAILED: the player did not fire" << std::endl;
+            return 1;
+        }
+        Uint32 end = first->getComponent<CLifetime>().mEnd;
         
-        auto previousTime(std::chrono::high_resolution_clock::now());
-        float lag = 0.0;
+        step(false);
+        first->destroy();
+        while (mTick != end) step(false);
+        step(true);
         
-        // Note: The "Game Update" pattern uses milliseconds per frame
-        const double FRAMES_PER_SECOND = 60.0;
+        Entity* second = torpedo();
+        if (second != first) {
+            std::cout << "FAILED: the pool did not hand the same torpedo out again" << std::endl;
+            return 1;
+        }
         
-        const double SECONDS_PER_UPDATE = (1.0 / FRAMES_PER_SECOND);
+        // A timer left from the old life would fire in the tick the
+        // torpedo is spawned again, and end the new torpedo there and then.
+        if (!second->isAlive()) {
+            std::cout << "FAILED: the timer of the torpedo's last life destroyed it" << std::endl;
+            return 1;
+        }
+        std::cout << "PASSED: the torpedo lived on past its old timer" << std::endl;
+        return 0;
+    }
+    
+    // --sprite-benchmark: draws the AI ship (the largest source rect)
+    // at random angles, rotating each draw and from rotation caches of
+    // increasing size, and measures how far each cache is from the exact
+    // rotation. Returns the process exit code.
+    int runSpriteBenchmark ()
+    {
+        const int width = 20, height = 20;
+        const int cacheSteps[] = { 16, 32, 64, 128, 256 };
+        
+        std::mt19937 gen(SPRITE_BENCHMARK_SEED);
+        std::uniform_real_distribution<> randomAngle(0.0, 360.0);
+        std::uniform_int_distribution<int> randomX(0, mWindowWidth - width);
+        std::uniform_int_distribution<int> randomY(0, mWindowHeight - height);
+        std::vector<double> angles(SPRITE_BENCHMARK_DRAWS);
+        std::vector<SDL_Point> positions(SPRITE_BENCHMARK_DRAWS);
+        for (int i = 0; i < SPRITE_BENCHMARK_DRAWS; i++) {
+            angles[i] = randomAngle(gen);
+            positions[i] = SDL_Point{randomX(gen), randomY(gen)};
+        }
         
-        while (mIsRunning)
-        {
-            auto currentTime(std::chrono::high_resolution_clock::now());
-            auto elapsedTimeMS = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - previousTime);
-            
-            previousTime = currentTime;
-            
-            // convert to seconds
-            lag += elapsedTimeMS.count() / 1000.0;
-            
-            handleInput();
-            
-            while (lag >= SECONDS_PER_UPDATE)
-            {
-                update( SECONDS_PER_UPDATE);
-                lag -= SECONDS_PER_UPDATE;
-                // Check for collisions
-                // We get our entities by group...
-                auto& spaceships(mManager.getEntitiesByGroup(EG_DESTROYABLE));
-                auto& photons(mManager.getEntitiesByGroup(EG_PHOTONTORPEDO));
-                
-                // Apply gravity to the photons
-                // THIS IS NOT THE BEST PLACE! HACK HACK HACK
-                for ( auto& photon : photons ) {
-                    float bh_x = mWindowWidth / 2.0;
-                    float bh_y = mWindowHeight / 2.0;
-                    
-                    // This is ridiculous!
-                    auto& pp(photon->getComponent<CPosition>());
-                    auto& plp(photon->getComponent<CLinearPhysics>());
-                    float dx = bh_x - pp.x();
-                    float dy = bh_y - pp.y();
-                    float d = std::sqrt( (bh_x - pp.x()) * (bh_x - pp.x()) + (bh_y - pp.y()) * (bh_y - pp.y()) );
-                    float s = 5000000.0f / (d*d);
-                    float sdx = dx / d;
-                    float sdy = dy / d;
-                    float ax = sdx * s;
-                    float ay = sdy * s;
-                    float vx = ax * SECONDS_PER_UPDATE;
-                    float vy = ay * SECONDS_PER_UPDATE;
-                    plp.mVelocity.x += vx;
-                    plp.mVelocity.y += vy;
-                }
-                
-                // Collision handling
-                for ( auto& photon : photons ) {
-                    auto& pphoton(photon->getComponent<CCollisionBox>());
-                 
-                    for ( auto& spaceship : spaceships ) {
-                        auto& pspaceship( spaceship->getComponent<CCollisionBox>());
-                        if (isIntersecting(pphoton, pspaceship)) {
-                            spaceship->destroy();
-                            
-                            auto& pos(spaceship->getComponent<CPosition>());
-                            createExplosion(pos.position.x, pos.position.y);
-                            this->mSoundSystem->playExplosion();
-                            photon->destroy();
-                            
-                            break;
-                        }
-                    }
-                }
+        auto nanosPerDraw = [&](const Sprite& sprite) {
+            mRenderer->beginFrame();
+            auto start(std::chrono::high_resolution_clock::now());
+            for (int i = 0; i < SPRITE_BENCHMARK_DRAWS; i++) {
+                sprite.draw(positions[i].x, positions[i].y, width, height, angles[i]);
             }
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+            SDL_RenderFlush(mRenderer->getRenderer());
+#endif
+            auto elapsed(std::chrono::high_resolution_clock::now() - start);
+            mRenderer->endFrame();
+            return 1.0 * std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / SPRITE_BENCHMARK_DRAWS;
+        };
+        
+        Sprite exact(*mAISpaceshipSprite);
+        double exactNanos = nanosPerDraw(exact);
+        std::cout << "Drawing the 610x530 AI ship sprite at " << width << "x" << height << ", "
+                  << SPRITE_BENCHMARK_DRAWS << " draws at random angles:" << std::endl;
+        std::cout << "  rotated per draw: " << exactNanos << " ns per draw" << std::endl;
+        
+        for (int steps : cacheSteps) {
+            Sprite cached(*mAISpaceshipSprite);
+            auto start(std::chrono::high_resolution_clock::now());
+            cached.cacheRotations(width, height, steps);
+            auto built(std::chrono::high_resolution_clock::now() - start);
             
-            //mManager.refresh();
-
+            double nanos = nanosPerDraw(cached);
+            double error, differing;
+            compareRotations(exact, cached, width, height, error, differing);
             
-            draw();
+            std::cout << "  " << steps << " angles: " << nanos << " ns per draw ("
+                      << exactNanos / nanos << "x), built in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(built).count() / 1000.0 << " ms, "
+                      << "mean error " << error << " of 255, " << 100.0 * differing << "% of pixels differ" << std::endl;
         }
         
+        return 0;
     }
     
-    void handleInput () {
+    // --lensing-benchmark: draws one frame with the black hole in the
+    // middle of the view, then lenses it LENSING_BENCHMARK_FRAMES times
+    // without SIMD, with SIMD on one thread, and with SIMD on the
+    // configured threads. Fails if the last one misses the frame budget
+    // on average. Returns the process exit code.
+    int runLensingBenchmark ()
+    {
+        mCamera.centerOn(mWorldWidth / 2.0f, mWorldHeight / 2.0f);
+        int x = mWindowWidth / 2, y = mWindowHeight / 2;
+        
+        struct Setup { const char* name; bool scalar; unsigned threads; };
+        const Setup setups[] = {
+            { "scalar, 1 thread", true, 1 },
+            { "SIMD, 1 thread", false, 1 },
+            { "SIMD, all threads", false, mLensing->threads() }
+        };
         
-        // The Input components will handle the rest
-    }
+        std::cout << "Lensing a " << 2 * LENSING_RADIUS << "x" << 2 * LENSING_RADIUS << " region of a "
+                  << mWindowWidth << "x" << mWindowHeight << " frame, " << LENSING_BENCHMARK_FRAMES
+                  << " times (milliseconds, mean / worst):" << std::endl;
+        
+        double mean = 0.0;
+        for (const Setup& setup : setups) {
+            LensingEffect lensing(mWindowWidth, mWindowHeight, setup.threads);
+            lensing.setLens(LENSING_RADIUS, LENSING_HORIZON, LENSING_STRENGTH);
+            lensing.setScalar(setup.scalar);
+            
+            mRenderer->beginFrame();
+            drawScene();
+            lensing.apply(mRenderer->getRenderer(), x, y);    // first use sets up the buffers
+            
+            LensingTimes sum, worst;
+            for (int i = 0; i < LENSING_BENCHMARK_FRAMES; i++) {
+                lensing.apply(mRenderer->getRenderer(), x, y);
+                const LensingTimes& times(lensing.times());
+                sum.readback += times.readback;
+                sum.process += times.process;
+                sum.upload += times.upload;
+                if (times.total() > worst.total()) worst = times;
+            }
+            mRenderer->endFrame();
+            
+            mean = 1000.0 * sum.total() / LENSING_BENCHMARK_FRAMES;
+            std::cout << "  " << setup.name << " (" << lensing.threads() << "): "
+                      << mean << " / " << 1000.0 * worst.total() << " total; "
+                      << 1000.0 * sum.process / LENSING_BENCHMARK_FRAMES << " process, "
+                      << 1000.0 * sum.readback / LENSING_BENCHMARK_FRAMES << " readback, "
+                      << 1000.0 * sum.upload / LENSING_BENCHMARK_FRAMES << " upload" << std::endl;
+        }
+        
+        if (mean > LENSING_BUDGET_MS) {
+            std::cout << "FAILED: over the " << LENSING_BUDGET_MS << " ms budget" << std::endl;
+            return 1;
+        }
+        std::cout << "PASSED: within the " << LENSING_BUDGET_MS << " ms budget" << std::endl;
+        return 0;
+    }
     
-    void draw () {
-        mRenderer->beginFrame();
+    // Adds a fleet of AI_BENCHMARK_FLEET pilots in view of the first
+    // player, where the chunks stay live, and times the AI over
+    // AI_BENCHMARK_TICKS ticks of the game. Returns the process exit code.
+    int runAIBenchmark ()
+    {
+        auto& player(mManager.getEntitiesByGroup(EG_HUMANSPACESHIP).front()->getComponent<CPosition>());
+        float reach = std::min(mWindowWidth, mWindowHeight) / 2.0f;
+        
+        std::mt19937 gen(AI_BENCHMARK_SEED);
+        std::uniform_real_distribution<float> randomOffset(-reach, reach);
+        std::uniform_real_distribution<float> randomRotationSpeed(-359.0f, 359.0f);
+        mManager.spawnBatch(mAISpaceshipPrefab, AI_BENCHMARK_FLEET, [&](Entity& entity, std::size_t) {
+            int posX = static_cast<int>(player.x() + randomOffset(gen));
+            int posY = static_cast<int>(player.y() + randomOffset(gen));
+            placeAISpaceship(entity, posX, posY, randomRotationSpeed(gen));
+        });
+        
+        const float seconds = 1.0f / mTicksPerSecond;
+        AITimes sum, worst;
+        std::size_t pilots = 0;
+        for (Uint32 i = 0; i < AI_BENCHMARK_TICKS; i++) {
+            mPlayerInputs[0] = InputFrame();
+            simulateTick(seconds);
+            
+            sum.think += mAITimes.think;
+            sum.act += mAITimes.act;
+            if (mAITimes.total() > worst.total()) worst = mAITimes;
+            pilots = std::max(pilots, mAIActors.size());
+        }
         
+        double mean = 1000.0 * sum.total() / AI_BENCHMARK_TICKS;
+        std::cout << "AI of up to " << pilots << " pilots, " << mAIThinkBudget << " thinking per tick on "
+                  << mAI->threads() << " thread(s), over " << AI_BENCHMARK_TICKS
+                  << " ticks (milliseconds, mean / worst):" << std::endl;
+        std::cout << "  think: " << 1000.0 * sum.think / AI_BENCHMARK_TICKS << " / " << 1000.0 * worst.think << std::endl;
+        std::cout << "  act: " << 1000.0 * sum.act / AI_BENCHMARK_TICKS << " / " << 1000.0 * worst.act << std::endl;
+        std::cout << "  total: " << mean << " / " << 1000.0 * worst.total() << std::endl;
+        
+        if (mean > AI_BUDGET_MS) {
+            std::cout << "FAILED: over the " << AI_BUDGET_MS << " ms budget" << std::endl;
+            return 1;
+        }
+        std::cout << "PASSED: within the " << AI_BUDGET_MS << " ms budget" << std::endl;
+        return 0;
+    }
+    
+    // --spawn-benchmark: fills empty managers with SPAWN_BENCHMARK_COUNT
+    // asteroids, spawned one at a time and then in one batch, and times
+    // both. A build that tracks allocations also counts them: the batch
+    // builds the components of all asteroids in one slab. Returns the
+    // process exit code.
+    int runSpawnBenchmark ()
+    {
+        struct Result {
+            double ms;
+            AllocTracker::Counts allocations;
+        };
+        auto measure = [this](bool batch) {
+            std::mt19937 gen(SPAWN_BENCHMARK_SEED);
+            std::uniform_int_distribution<int> randomX(0, mWorldWidth);
+            std::uniform_int_distribution<int> randomY(0, mWorldHeight);
+            auto place = [&](Entity& entity, std::size_t) {
+                placeAsteroid(entity, randomX(gen), randomY(gen));
+            };
+            
+            Manager manager;
+            auto prefab = manager.registerPrefab([this](Entity& entity) {
+                buildAsteroid(entity);
+            }, 0);
+            
+            AllocTracker::takeFrame();
+            auto start(std::chrono::high_resolution_clock::now());
+            if (batch) {
+                manager.spawnBatch(prefab, SPAWN_BENCHMARK_COUNT, place);
+            } else {
+                for (std::size_t i = 0; i < SPAWN_BENCHMARK_COUNT; i++) place(manager.spawn(prefab), i);
+            }
+            manager.refresh();
+            auto elapsed(std::chrono::high_resolution_clock::now() - start);
+            
+            Result result;
+            result.ms = std::chrono::duration<double, std::milli>(elapsed).count();
+            result.allocations = AllocTracker::takeFrame().total();
+            return result;
+        };
         
-        mRenderer->draw(*mBackground);
+        Result single(measure(false));
+        Result batch(measure(true));
+        
+        std::cout << "Spawning " << SPAWN_BENCHMARK_COUNT << " asteroids:" << std::endl;
+        std::cout << "  one at a time: " << single.ms << " ms";
+        if (AllocTracker::kEnabled) std::cout << ", " << single.allocations.allocations << " allocations";
+        std::cout << std::endl;
+        std::cout << "  in one batch: " << batch.ms << " ms";
+        if (AllocTracker::kEnabled) std::cout << ", " << batch.allocations.allocations << " allocations";
+        std::cout << std::endl;
+        
+        if (batch.ms > SPAWN_BUDGET_MS) {
+            std::cout << "FAILED: over the " << SPAWN_BUDGET_MS << " ms budget" << std::endl;
+            return 1;
+        }
+        // Each entity still allocates itself and its two component lists.
+        std::uint64_t most = 3 * static_cast<std::uint64_t>(SPAWN_BENCHMARK_COUNT) + SPAWN_BENCHMARK_SLACK;
+        if (AllocTracker::kEnabled && batch.allocations.allocations > most) {
+            std::cout << "FAILED: the batch allocated more than " << most << " times" << std::endl;
+            return 1;
+        }
+        std::cout << "PASSED: within the " << SPAWN_BUDGET_MS << " ms budget" << std::endl;
+        return 0;
+    }
+    
+    Window* getWindow();
+    Renderer* getRenderer();
+    
+protected:
+    // See the "Game Update" pattern
+    // http://gameprogrammingpatterns.com/game-loop.html
+    void gameLoop ()
+    {
+        using FrameTime = float;
+        
+        mIsRunning = true;
+        
+        // Loading the world is not part of any frame.
+        AllocTracker::takeFrame();
+        RenderStats::takeDrawCalls();
+        
+        auto previousTime(std::chrono::high_resolution_clock::now());
+        float lag = 0.0;
+        
+        // Note: The "Game Update" pattern uses milliseconds per frame
+        const double FRAMES_PER_SECOND = mTicksPerSecond;
+        
+        const double SECONDS_PER_UPDATE = (1.0 / FRAMES_PER_SECOND);
+        
+        while (mIsRunning)
+        {
+            auto currentTime(std::chrono::high_resolution_clock::now());
+            auto elapsedTimeMS = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - previousTime);
+            double frameSeconds = std::chrono::duration<double>(currentTime - previousTime).count();
+            Uint32 ticks = 0;
+            
+            previousTime = currentTime;
+            
+            // convert to seconds
+            lag += elapsedTimeMS.count() / 1000.0;
+            
+            while (mIsRunning && lag >= SECONDS_PER_UPDATE)
+            {
+                handleInput();
+                if (!mIsRunning) break;
+                
+                if (mLockstep) {
+                    if (!advanceLockstep( SECONDS_PER_UPDATE )) {
+                        // Waiting for the other player; catch up later,
+                        // but not by more than a few ticks at once.
+                        lag = std::min<float>(lag, MAX_CATCHUP_TICKS * SECONDS_PER_UPDATE);
+                        break;
+                    }
+                } else {
+                    mPlayerInputs[0] = mInput;
+                    mInputConsumed = true;
+                    simulateTick( SECONDS_PER_UPDATE );
+                }
+                
+                lag -= SECONDS_PER_UPDATE;
+                ++ticks;
+            }
+            
+            //mManager.refresh();
+
+            
+            moveCamera( elapsedTimeMS.count() / 1000.0f );
+            draw( std::min(lag / SECONDS_PER_UPDATE, 1.0) );
+            
+            if (mAllocReport || mHudVisible) countFrameAllocations();
+            if (mHudVisible) sampleHud(frameSeconds, ticks);
+        }
+        
+        if (mLockstep) {
+            mLockstep->report(std::cout, mTick, SECONDS_PER_UPDATE);
+        }
+        
+        const auto& torpedoes(mManager.getPoolStats(mTorpedoPrefab));
+        std::cout << "Torpedo pool: " << torpedoes.built << " built, at most " << torpedoes.highWater
+                  << " in use, " << torpedoes.misses << " spawns past the reserve" << std::endl;
+        
+        if (mAllocReport) reportAllocations();
+        if (mCapture) reportCapture();
+        if (mLatency.samples() > 0 || mLatency.lost() > 0) mLatency.report(std::cout);
+        
+        if (mTrajectory && mTrajectory->stats().computes > 0) {
+            const auto& trajectory(mTrajectory->stats());
+            std::cout << "Trajectory preview: integrated on " << trajectory.computes << " of " << trajectory.requests
+                      << " frames, " << 1e6 * trajectory.seconds / trajectory.computes << " us on average, "
+                      << 1e6 * trajectory.worstSeconds << " us at worst" << std::endl;
+        }
+        
+        const auto chunks(mChunks->stats());
+        std::cout << "Chunks: " << chunks.frozen << " of " << mChunks->count() << " frozen, "
+                  << chunks.pagedOut << " entities paged out, " << chunks.pagedIn << " paged in; loads "
+                  << chunks.prefetched << " ready, " << chunks.waited << " waited for, "
+                  << chunks.built << " unprefetched" << std::endl;
+    }
+    
+    // Waits for the writer first, so the counts are final.
+    void reportCapture() {
+        mCapture->finish();
+        FrameCaptureStats stats(mCapture->stats());
+        
+        std::cout << "Capture: " << stats.written << " of " << stats.offered << " frames written, "
+                  << stats.dropped << " dropped; " << stats.fileBytes << " bytes ("
+                  << 100.0 * stats.fileBytes / std::max<Uint64>(stats.rawBytes, 1) << "% of raw); "
+                  << 1000.0 * stats.mainThreadSeconds / std::max<Uint32>(stats.offered, 1)
+                  << " ms per frame on the game loop" << std::endl;
+    }
+    
+    void countFrameAllocations() {
+        AllocTracker::Frame frame(AllocTracker::takeFrame());
+        for (int t = 0; t < AllocTracker::TAG_COUNT; t++) {
+            mAllocTotals.tags[t].allocations += frame.tags[t].allocations;
+            mAllocTotals.tags[t].bytes += frame.tags[t].bytes;
+        }
+        if (frame.total().allocations > mAllocWorst.total().allocations) mAllocWorst = frame;
+        ++mAllocFrames;
+        mHudSamples.allocations += frame.total().allocations;
+    }
+    
+    void reportAllocations() const {
+        std::cout << "Allocations per frame over " << mAllocFrames << " frames:" << std::endl;
+        printAllocations(mAllocTotals, mAllocFrames);
+        std::cout << "Worst frame:" << std::endl;
+        printAllocations(mAllocWorst, 1);
+        std::cout << AllocTracker::hotViolations() << " allocations inside ticks" << std::endl;
+    }
+    
+    static unsigned lensingThreads(const GameOptions& options) {
+        if (options.lensingThreads > 0) return options.lensingThreads;
+        
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        return cores < LENSING_MAX_THREADS ? cores : LENSING_MAX_THREADS;
+    }
+    
+    // Draws both sprites at SPRITE_BENCHMARK_SAMPLES evenly spread angles
+    // (between the cached ones, mostly) and compares the pixels: the mean
+    // difference per color channel, and the fraction of pixels that differ.
+    void compareRotations(const Sprite& exact, const Sprite& cached, int width, int height,
+                          double& meanError, double& differing)
+    {
+        SDL_Renderer* renderer(mRenderer->getRenderer());
+        Uint8 r, g, b, a;
+        SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+        
+        // Room for any angle, as in the cache.
+        const int size = static_cast<int>(std::ceil(std::sqrt(1.0 * width * width + 1.0 * height * height))) + 2;
+        SharedSDLTexture target(make_shared(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                                              SDL_TEXTUREACCESS_TARGET, size, size)));
+        if (!target) {
+            throw std::runtime_error("Unable to create the sprite benchmark target.");
+        }
+        
+        std::vector<Uint32> exactPixels(size * size), cachedPixels(size * size);
+        auto capture = [&](const Sprite& sprite, double angle, std::vector<Uint32>& pixels) {
+            SDL_SetRenderTarget(renderer, target.get());
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
+            sprite.draw((size - width) / 2, (size - height) / 2, width, height, angle);
+            SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels.data(), size * sizeof(Uint32));
+            SDL_SetRenderTarget(renderer, NULL);
+        };
+        
+        Uint64 channelError = 0, pixelsDiffering = 0;
+        for (int i = 0; i < SPRITE_BENCHMARK_SAMPLES; i++) {
+            double angle = 360.0 * (i + 0.5) / SPRITE_BENCHMARK_SAMPLES;
+            capture(exact, angle, exactPixels);
+            capture(cached, angle, cachedPixels);
+            
+            for (std::size_t p = 0; p < exactPixels.size(); p++) {
+                Uint32 e = exactPixels[p], c = cachedPixels[p];
+                if (e != c) ++pixelsDiffering;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    channelError += std::abs(static_cast<int>((e >> shift) & 0xFF) - static_cast<int>((c >> shift) & 0xFF));
+                }
+            }
+        }
+        SDL_SetRenderDrawColor(renderer, r, g, b, a);
+        
+        double pixels = 1.0 * SPRITE_BENCHMARK_SAMPLES * exactPixels.size();
+        meanError = channelError / (4.0 * pixels);
+        differing = pixelsDiffering / pixels;
+    }
+    
+    // One line per tag that allocated, averaged over `frames`.
+    static void printAllocations(const AllocTracker::Frame& frame, Uint64 frames) {
+        frames = std::max<Uint64>(frames, 1);
+        for (int t = 0; t < AllocTracker::TAG_COUNT; t++) {
+            const auto& counts(frame.tags[t]);
+            if (counts.allocations == 0) continue;
+            
+            std::cout << "  " << AllocTracker::tagName(static_cast<AllocTracker::Tag>(t)) << ": "
+                      << 1.0 * counts.allocations / frames << " allocations, "
+                      << 1.0 * counts.bytes / frames << " bytes" << std::endl;
+        }
+        if (frame.total().allocations == 0) std::cout << "  none" << std::endl;
+    }
+    
+    // Advances the world by one fixed step using mPlayerInputs.
+    // A steady-state tick must not allocate; the exceptions (chunk
+    // streaming, recording) open a ColdRegion.
+    void simulateTick (float seconds) {
+        AllocTracker::HotRegion hot("tick");
+        AllocTracker::Scope tag(AllocTracker::TAG_SIMULATION);
+        
+        update( seconds );
+        
+        // Check for collisions
+        // We get our entities by group...
+        auto& spaceships(mManager.getEntitiesByGroup(EG_DESTROYABLE));
+        auto& photons(mManager.getEntitiesByGroup(EG_PHOTONTORPEDO));
+        
+        // Apply gravity to the photons, which are the only bodies with
+        // linear physics.
+        // THIS IS NOT THE BEST PLACE! HACK HACK HACK
+        // Views keep destroyed entities until the next refresh.
+        for ( auto& body : mManager.view<CPosition, CLinearPhysics>() ) {
+            if (!body.entity->isAlive()) continue;
+            
+            float bh_x = mWorldWidth / 2.0;
+            float bh_y = mWorldHeight / 2.0;
+            
+            auto& pp(body.get<CPosition>());
+            auto& plp(body.get<CLinearPhysics>());
+            float dx = bh_x - pp.x();
+            float dy = bh_y - pp.y();
+            float d = std::sqrt( (bh_x - pp.x()) * (bh_x - pp.x()) + (bh_y - pp.y()) * (bh_y - pp.y()) );
+            float s = BLACK_HOLE_ATTRACTION / (d*d);
+            float sdx = dx / d;
+            float sdy = dy / d;
+            float ax = sdx * s;
+            float ay = sdy * s;
+            float vx = ax * seconds;
+            float vy = ay * seconds;
+            plp.mVelocity.x += vx;
+            plp.mVelocity.y += vy;
+        }
+        
+        // Collision detection only records the hits; handleEvents decides
+        // what they do.
+        // Boxes are swept along this tick's motion, so fast torpedoes
+        // cannot pass through a ship between two ticks. With pixel
+        // collisions, the masks then check the boxes' hits.
+        AllocTracker::Scope collisionTag(AllocTracker::TAG_COLLISION);
+        for ( auto& photon : photons ) {
+            auto& pphoton(photon->getComponent<CCollisionBox>());
+            Vector2f photonMotion(motionOf(*photon));
+         
+            for ( auto& spaceship : spaceships ) {
+                auto& pspaceship( spaceship->getComponent<CCollisionBox>());
+                Vector2f spaceshipMotion(motionOf(*spaceship));
+                float time, exitTime;
+                if (!isSweptIntersecting(pphoton, photonMotion, pspaceship, spaceshipMotion, time, exitTime)) continue;
+                if (mPixelCollisions && !isPixelIntersecting(*photon, photonMotion, *spaceship, spaceshipMotion, time, exitTime)) continue;
+                
+                mEvents.emit(CollisionEvent{photon, spaceship, time});
+            }
+        }
+        
+        handleEvents();
+        
+        if (!mResimulating) {
+            AllocTracker::Scope particlesTag(AllocTracker::TAG_PARTICLES);
+            emitExhaust();
+            mParticles.update( seconds );
+        }
+        
+        recordTick();
+    }
+    
+    // Applies the events queued during this tick. Collisions go first, so a
+    // torpedo leaving the screen on the tick it hits something still counts.
+    void handleEvents () {
+        bool exploded = false;
+        
+        // Earliest hits first, so a torpedo stops at the first ship in its path.
+        auto& hits(mEvents.events<CollisionEvent>());
+        std::sort(hits.begin(), hits.end(), [](const CollisionEvent& a, const CollisionEvent& b) {
+            return a.time < b.time;
+        });
+        
+        for (auto& hit : hits) {
+            // Whatever gets hit reacts, even if it was sleeping.
+            hit.photon->wake();
+            hit.target->wake();
+            
+            // A torpedo only destroys one target, and a target only
+            // explodes once, even when the hits overlap.
+            if (!hit.photon->isAlive() || !hit.target->isAlive()) continue;
+            
+            hit.photon->destroy();
+            hit.target->destroy();
+            
+            auto& pos(hit.target->getComponent<CPosition>());
+            createExplosion(pos.position.x, pos.position.y);
+            exploded = true;
+        }
+        
+        for (auto& out : mEvents.events<OutOfBoundsEvent>()) {
+            out.entity->destroy();
+        }
+        
+        if (exploded && !mResimulating) {
+            mSoundSystem->playExplosion();
+        }
+        
+        mEvents.clear();
+    }
+    
+    // One lockstep tick: exchange input with the other player, roll back
+    // and re-simulate if a prediction of their input turned out wrong, then
+    // simulate. Returns false while stalled waiting for the other player.
+    bool advanceLockstep (float seconds) {
+        AllocTracker::Scope tag(AllocTracker::TAG_NETWORK);
+        
+        mLockstep->poll();
+        
+        if (mLockstep->peerLeft()) {
+            std::cout << "The other player left the game." << std::endl;
+            mIsRunning = false;
+            return false;
+        }
+        
+        if (mLockstep->desynced()) {
+            std::ostringstream oss;
+            oss << "Lockstep desync detected at tick " << mLockstep->desyncTick();
+            throw std::runtime_error(oss.str());
+        }
+        
+        if (!mLockstep->canAdvance(mTick)) {
+            mLockstep->noteStall();
+            mLockstep->flush();
+            return false;
+        }
+        
+        mLockstep->addLocalInput(mInput);
+        mInputConsumed = true;
+        mLockstep->flush();
+        
+        Uint32 from;
+        if (mLockstep->takeRollback(from) && from < mTick) {
+            Uint32 target = mTick;
+            loadSnapshot(mRollbackSnapshots[from % mRollbackSnapshots.size()],
+                         &mRollbackChunks[from % mRollbackChunks.size()]);
+            
+            mResimulating = true;
+            while (mTick < target) {
+                stepLockstep(seconds);
+            }
+            mResimulating = false;
+            
+            mLockstep->noteResimulated(target - from);
+        }
+        
+        stepLockstep(seconds);
+        
+        if (mTick % (LOCKSTEP_REPORT_SECONDS * mTicksPerSecond) == 0) {
+            mLockstep->report(std::cout, mTick, seconds);
+        }
+        
+        return true;
+    }
+    
+    void stepLockstep (float seconds) {
+        // Keep the state before every tick that may still be rolled back.
+        {
+            AllocTracker::Scope tag(AllocTracker::TAG_SNAPSHOT);
+            saveSnapshot(mRollbackSnapshots[mTick % mRollbackSnapshots.size()],
+                         &mRollbackChunks[mTick % mRollbackChunks.size()]);
+        }
+        
+        Uint32 tick = mTick;
+        mLockstep->inputsFor(tick, mPlayerInputs);
+        simulateTick(seconds);
+        
+        if (tick % LockstepSession::kCheckInterval == 0) {
+            mLockstep->recordStateHash(tick, hashWorldState());
+        }
+    }
+    
+    // Samples the input for the next tick, either live from SDL or from
+    // the replay log. The Input components will handle the rest.
+    void handleInput () {
+        AllocTracker::Scope tag(AllocTracker::TAG_INPUT);
+        
+        // Input sampled while a lockstep game was stalled is kept for the
+        // next tick instead of being dropped.
+        if (mInputConsumed) {
+            mInput.clear();
+            mInputConsumed = false;
+        }
+        
+        SDL_Event e;
+        while (SDL_PollEvent(&e)) {
+            if (e.type == SDL_QUIT) {
+                mIsRunning = false;
+                return;
+            }
+            else if( e.type == SDL_KEYDOWN )
+            {
+                switch( e.key.keysym.sym )
+                {
+                    case SDLK_UP:
+                    {
+                        // Presses past the most one tick can fire are
+                        // dropped, so they are not traced either.
+                        int fires = mInput.fireCount();
+                        mInput.addFire();
+                        if (mInput.fireCount() > fires && !mReplayPlayer) mLatency.press(e.key.timestamp);
+                        break;
+                    }
+                    case SDLK_F3:
+                        toggleHud();
+                        break;
+                    case SDLK_F5:
+                        quickSave();
+                        break;
+                    case SDLK_F9:
+                        quickLoad();
+                        break;
+                }
+            }
+        }
+        
+        if (mReplayPlayer) {
+            if (!mReplayPlayer->hasTick(mTick)) {
+                std::cout << "Replay verified: " << mTick << " ticks matched." << std::endl;
+                mIsRunning = false;
+                return;
+            }
+            
+            mInput = mReplayPlayer->input(mTick);
+            return;
+        }
+        
+        const Uint8* currentKeyStates = SDL_GetKeyboardState( NULL );
+        mInput.setLeft( currentKeyStates[ SDL_SCANCODE_LEFT ] != 0 );
+        mInput.setRight( currentKeyStates[ SDL_SCANCODE_RIGHT ] != 0 );
+    }
+    
+    // Hashes the state that matters for determinism: the alive set,
+    // positions and velocities.
+    Uint32 hashWorldState() const {
+        StateHash hash;
+        
+        for (auto& e : mManager.getEntities()) {
+            if (!e->isAlive()) continue;
+            
+            if (e->hasComponent<CPosition>()) {
+                auto& p(e->getComponent<CPosition>());
+                hash.add(p.x());
+                hash.add(p.y());
+            }
+            
+            if (e->hasComponent<CLinearPhysics>()) {
+                auto& lp(e->getComponent<CLinearPhysics>());
+                hash.add(lp.mVelocity.x);
+                hash.add(lp.mVelocity.y);
+            }
+        }
+        
+        return hash.value();
+    }
+    
+    // Called at the end of every fixed-step tick.
+    // Recording and checkpoints grow their logs, so they may allocate.
+    void recordTick() {
+        AllocTracker::ColdRegion cold;
+        AllocTracker::Scope tag(AllocTracker::TAG_SNAPSHOT);
+        
+        if (mReplayRecorder || mReplayPlayer) {
+            Uint32 stateHash = hashWorldState();
+            
+            if (mReplayRecorder) {
+                mReplayRecorder->record(mPlayerInputs[0], stateHash);
+            }
+            
+            if (mReplayPlayer && mReplayPlayer->stateHash(mTick) != stateHash) {
+                std::ostringstream oss;
+                oss << "Replay diverged at tick " << mTick << " (expected state hash "
+                    << mReplayPlayer->stateHash(mTick) << ", got " << stateHash << ")";
+                throw std::runtime_error(oss.str());
+            }
+        }
+        
+        ++mTick;
+        
+        if (mCheckpointWriter && mTick % mCheckpointInterval == 0) {
+            saveSnapshot(mCheckpoint);
+            mCheckpointWriter->write(mCheckpoint);
+        }
+    }
+    
+    // Snapshot layout: magic, version, seed, tick, the AI think cursor
+    // (u32), the entity data written by EntitySystem::Manager::serialize, then a flag (u8) and, if set, the
+    // frozen chunks. Rollback snapshots leave the chunks out and keep the
+    // chunk table by reference instead (`chunks`), since frozen chunks do
+    // not change from tick to tick.
+    void saveSnapshot(std::vector<Uint8>& snapshot, Chunks::Table* chunks = nullptr) const {
+        SnapshotWriter writer(snapshot);
+        writer.write(Uint32(SNAPSHOT_MAGIC));
+        writer.write(Uint32(SNAPSHOT_VERSION));
+        writer.write(mSeed);
+        writer.write(mTick);
+        writer.write(mAICursor);
+        mManager.serialize(writer);
+        
+        writer.write(Uint8(chunks == nullptr));
+        if (chunks) *chunks = mChunks->table();
+        else mChunks->serialize(writer);
+    }
+    
+    void loadSnapshot(const std::vector<Uint8>& snapshot, const Chunks::Table* chunks = nullptr) {
+        SnapshotReader reader(snapshot);
+        if (reader.read<Uint32>() != SNAPSHOT_MAGIC || reader.read<Uint32>() != SNAPSHOT_VERSION) {
+            throw std::runtime_error("Not a snapshot of this version of the game.");
+        }
+        reader.read(mSeed);
+        reader.read(mTick);
+        reader.read(mAICursor);
+        mAnimations.advance(mTick);
         
-        mManager.draw();
+        // The bodies may not survive the restore; the next tick gathers them again.
+        mBodies.clear();
+        mAIActors.clear();
         
+        mManager.deserialize(reader, [this](const Entity::GroupBitset& groups) -> Entity& {
+            return createEntityForGroups(groups);
+        });
+        
+        // The factories set timers for the state the entities were created
+        // with; scheduleTimers sets them from the restored state instead.
+        // Tick mTick has not been simulated yet, so its timers are still to fire.
+        mTimers.reset(mTick - 1);
+        
+        if (reader.read<Uint8>()) mChunks->deserialize(reader);
+        else if (chunks) mChunks->restore(*chunks);
+        else throw std::runtime_error("Snapshot does not contain the frozen chunks.");
+        
+        scheduleTimers();
+    }
+    
+    // F5 keeps an in-memory snapshot that F9 restores. Not in a two-player
+    // game: a snapshot restored on one peer only would desync it for good.
+    void quickSave() {
+        if (mLockstep) {
+            std::cout << "Snapshots cannot be saved in a two-player game." << std::endl;
+            return;
+        }
+        
+        auto start(std::chrono::high_resolution_clock::now());
+        saveSnapshot(mQuickSave);
+        auto elapsed(std::chrono::high_resolution_clock::now() - start);
+        
+        std::cout << "Saved snapshot: " << mQuickSave.size() << " bytes in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " us" << std::endl;
+    }
+    
+    void quickLoad() {
+        if (mQuickSave.empty()) return;
+        if (mReplayRecorder || mReplayPlayer) {
+            std::cout << "Snapshots cannot be loaded while recording or replaying." << std::endl;
+            return;
+        }
+        if (mLockstep) {
+            std::cout << "Snapshots cannot be loaded in a two-player game." << std::endl;
+            return;
+        }
+        
+        auto start(std::chrono::high_resolution_clock::now());
+        loadSnapshot(mQuickSave);
+        auto elapsed(std::chrono::high_resolution_clock::now() - start);
+        
+        std::cout << "Loaded snapshot in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " us" << std::endl;
+    }
+    
+    // `alpha` is how far the frame is between the last tick and the next
+    // one; moving bodies are drawn that far along their last motion.
+    void draw (float alpha) {
+        AllocTracker::Scope tag(AllocTracker::TAG_RENDER);
+        
+        for (auto* body : mBodies) {
+            if (!body->entity->hasComponent<CSprite>()) continue;
+            
+            body->entity->getComponent<CSprite>().setCenter(
+                body->mPrevious.x + (body->x() - body->mPrevious.x) * alpha,
+                body->mPrevious.y + (body->y() - body->mPrevious.y) * alpha);
+        }
+        
+        mRenderer->beginFrame();
+        drawScene();
+        drawLensing();
+        if (mHudVisible) drawHud();
+        if (mCapture) mCapture->capture(mRenderer->getRenderer());
         mRenderer->endFrame();
+        mLatency.presented();
+    }
+    
+    void drawScene () {
+        mRenderer->draw(*mBackground);
+        drawTrajectory();
+        
+        // Culling: only entities overlapping the view are submitted.
+        for (auto& e : mManager.getEntities()) {
+            if (isOnScreen(*e)) e->draw();
+        }
+        
+        mParticles.draw(mCamera);
+    }
+    
+    // A dotted line along the path a torpedo fired by the local player now
+    // would take, ending in a red mark if it would hit something. The path
+    // is cached (see TrajectoryPreview); it is integrated again when the
+    // ship turns past the cached headings, or every TRAJECTORY_MAX_AGE ticks
+    // since what it passes moves and dies.
+    void drawTrajectory () {
+        if (!mTrajectory) return;
+        
+        int localPlayer = mLockstep ? mLockstep->localPlayer() : 0;
+        for (auto& ship : mManager.getEntitiesByGroup(EG_HUMANSPACESHIP)) {
+            if (ship->getComponent<CInputHuman>().mPlayer != localPlayer) continue;
+            
+            // Torpedoes start at the ship's position, truncated as
+            // createPhotonTorpedo does.
+            auto& p(ship->getComponent<CPosition>());
+            float x = static_cast<float>(static_cast<int>(p.x()));
+            float y = static_cast<float>(static_cast<int>(p.y()));
+            float heading = ship->getComponent<CDirection>().angle();
+            
+            if (mTick - mTrajectoryTick >= TRAJECTORY_MAX_AGE) mTrajectory->invalidate();
+            if (!mTrajectory->covers(x, y, heading)) {
+                mTrajectoryObstacles.clear();
+                for (auto& e : mManager.getEntitiesByGroup(EG_DESTROYABLE)) {
+                    if (!e->isAlive()) continue;
+                    auto& box(e->getComponent<CCollisionBox>());
+                    mTrajectoryObstacles.push_back({box.left() - TORPEDO_HALF_WIDTH, box.top() - TORPEDO_HALF_HEIGHT,
+                                                    box.right() + TORPEDO_HALF_WIDTH, box.bottom() + TORPEDO_HALF_HEIGHT});
+                }
+                mTrajectory->compute(x, y, heading, mTrajectoryObstacles);
+                mTrajectoryTick = mTick;
+            }
+            
+            SDL_Renderer* renderer = mRenderer->getRenderer();
+            int last = mTrajectory->size() - 1;
+            mTrajectoryDots.clear();
+            for (int i = TRAJECTORY_DOT_TICKS - 1; i < last; i += TRAJECTORY_DOT_TICKS) {
+                SDL_Rect dot{static_cast<int>(mTrajectory->x(i)) - 1, static_cast<int>(mTrajectory->y(i)) - 1, 2, 2};
+                mTrajectoryDots.push_back(mCamera.toScreen(dot));
+            }
+            SDL_SetRenderDrawColor(renderer, 170, 170, 200, 255);
+            SDL_RenderFillRects(renderer, mTrajectoryDots.data(), static_cast<int>(mTrajectoryDots.size()));
+            RenderStats::countDrawCall();
+            
+            if (last >= 0 && mTrajectory->hits()) {
+                SDL_Rect mark{static_cast<int>(mTrajectory->x(last)) - 2, static_cast<int>(mTrajectory->y(last)) - 2, 4, 4};
+                mark = mCamera.toScreen(mark);
+                SDL_SetRenderDrawColor(renderer, 255, 60, 60, 255);
+                SDL_RenderFillRect(renderer, &mark);
+                RenderStats::countDrawCall();
+            }
+        }
+    }
+    
+    // The black hole in the middle of the world bends the light of
+    // whatever is drawn around it.
+    void drawLensing () {
+        if (!mLensing) return;
+        
+        float x = mWorldWidth / 2.0f;
+        float y = mWorldHeight / 2.0f;
+        if (!mCamera.isVisible(x - LENSING_RADIUS, y - LENSING_RADIUS, x + LENSING_RADIUS, y + LENSING_RADIUS)) return;
+        
+        mLensing->apply(mRenderer->getRenderer(),
+                        static_cast<int>(std::floor(x)) - mCamera.screenX(),
+                        static_cast<int>(std::floor(y)) - mCamera.screenY());
+    }
+    
+    // The performance HUD. It is laid out again from the frames sampled
+    // since every HUD_REFRESH_SECONDS, into a fixed buffer and a TextBatch
+    // that keeps its capacity, and drawn as is in between, so showing it
+    // costs two draw calls a frame and no allocations.
+    void drawHud () {
+        if (mHudSamples.seconds >= HUD_REFRESH_SECONDS) layOutHud();
+        
+        SDL_Renderer* renderer = mRenderer->getRenderer();
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+        SDL_RenderFillRect(renderer, &mHudPanel);
+        RenderStats::countDrawCall();
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        
+        mRenderer->draw(*mHud);
+    }
+    
+    void layOutHud () {
+        static const char* const groupNames[EG_COUNT] = {
+            "black holes", "torpedoes", "ships", "players", "asteroids", "destroyable"
+        };
+        
+        const HudSamples& h(mHudSamples);
+        mHudText[0] = '\0';
+        appendText(mHudText, sizeof(mHudText), "frame  %5.2f ms, %5.2f worst (%.0f fps)\n",
+                   1000.0 * h.seconds / h.frames, 1000.0 * h.worstSeconds, h.frames / h.seconds);
+        appendText(mHudText, sizeof(mHudText), "ticks  %4.2f per frame (tick %u)\n",
+                   1.0 * h.ticks / h.frames, static_cast<unsigned>(mTick));
+        appendText(mHudText, sizeof(mHudText), "draws  %.0f per frame\n", 1.0 * h.drawCalls / h.frames);
+        if (AllocTracker::kEnabled) {
+            appendText(mHudText, sizeof(mHudText), "allocs %.1f per frame\n", 1.0 * h.allocations / h.frames);
+        } else {
+            appendText(mHudText, sizeof(mHudText), "allocs n/a (not tracked in this build)\n");
+        }
+        if (mLatency.samples() > 0) {
+            appendText(mHudText, sizeof(mHudText), "input  %5.1f ms median, %5.1f p99 (%u shots)\n",
+                       mLatency.percentile(LatencyTrace::STAGE_TOTAL, 0.5),
+                       mLatency.percentile(LatencyTrace::STAGE_TOTAL, 0.99), static_cast<unsigned>(mLatency.samples()));
+        } else {
+            appendText(mHudText, sizeof(mHudText), "input  n/a (no shots yet)\n");
+        }
+        for (std::size_t g = 0; g < EG_COUNT; g++) {
+            appendText(mHudText, sizeof(mHudText), "\n%-12s %6u", groupNames[g],
+                       static_cast<unsigned>(mManager.getEntitiesByGroup(g).size()));
+        }
+        
+        mHud->clear();
+        mHud->add(HUD_MARGIN, HUD_MARGIN, mHudText, SDL_Color{220, 220, 220, 255}, HUD_SCALE);
+        mHudPanel = TextBatch::measure(mHudText, HUD_SCALE);
+        mHudPanel.x = HUD_MARGIN / 2;
+        mHudPanel.y = HUD_MARGIN / 2;
+        mHudPanel.w += HUD_MARGIN;
+        mHudPanel.h += HUD_MARGIN;
+        
+        mHudSamples = HudSamples();
+    }
+    
+    // Called once per frame while the HUD is shown, after the frame's
+    // allocations were counted.
+    void sampleHud (double frameSeconds, Uint32 ticks) {
+        ++mHudSamples.frames;
+        mHudSamples.seconds += frameSeconds;
+        if (frameSeconds > mHudSamples.worstSeconds) mHudSamples.worstSeconds = frameSeconds;
+        mHudSamples.ticks += ticks;
+        mHudSamples.drawCalls += RenderStats::takeDrawCalls();
+    }
+    
+    void toggleHud () {
+        mHudVisible = !mHudVisible;
+        if (!mHudVisible) return;
+        
+        // Start from an empty HUD; nothing from while it was hidden counts.
+        mHud->clear();
+        mHudPanel = SDL_Rect{0, 0, 0, 0};
+        mHudSamples = HudSamples();
+        RenderStats::takeDrawCalls();
+        if (!mAllocReport) AllocTracker::takeFrame();
+    }
+    
+    // vsnprintf to the end of the text already in `buffer`. Text that does
+    // not fit is cut off.
+    static void appendText (char* buffer, std::size_t size, const char* format, ...) {
+        std::size_t used = std::strlen(buffer);
+        if (used + 1 >= size) return;
+        
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(buffer + used, size - used, format, args);
+        va_end(args);
+    }
+    
+    // Conservative screen test from what the entity draws, or from its
+    // collision box if it draws nothing we know the size of.
+    bool isOnScreen(const Entity& entity) const {
+        if (entity.hasComponent<CSprite>()) {
+            return mCamera.isVisibleRotated(entity.getComponent<CSprite>().mRect);
+        }
+        if (entity.hasComponent<CSpriteAnimation>()) {
+            const SDL_Rect& r(entity.getComponent<CSpriteAnimation>().mRect);
+            return mCamera.isVisible(r.x, r.y, r.x + r.w, r.y + r.h);
+        }
+        if (entity.hasComponent<CCollisionBox>()) {
+            auto& box(entity.getComponent<CCollisionBox>());
+            return mCamera.isVisible(box.left(), box.top(), box.right(), box.bottom());
+        }
+        return true;
+    }
+    
+    // The camera follows the local player's ship. WASD pans away from it
+    // and C goes back to following. This is only a view, so it is neither
+    // part of the tick's input nor of snapshots and replays.
+    void moveCamera(float seconds) {
+        const Uint8* keys = SDL_GetKeyboardState( NULL );
+        float dx = 1.0f * (keys[SDL_SCANCODE_D] != 0) - (keys[SDL_SCANCODE_A] != 0);
+        float dy = 1.0f * (keys[SDL_SCANCODE_S] != 0) - (keys[SDL_SCANCODE_W] != 0);
+        
+        if (dx != 0.0f || dy != 0.0f) {
+            mCameraFollows = false;
+            mCamera.move(dx * CAMERA_PAN_SPEED * seconds, dy * CAMERA_PAN_SPEED * seconds);
+            return;
+        }
+        if (keys[SDL_SCANCODE_C]) mCameraFollows = true;
+        if (!mCameraFollows) return;
+        
+        int localPlayer = mLockstep ? mLockstep->localPlayer() : 0;
+        for (auto& ship : mManager.getEntitiesByGroup(EG_HUMANSPACESHIP)) {
+            if (ship->getComponent<CInputHuman>().mPlayer != localPlayer) continue;
+            
+            auto& p(ship->getComponent<CPosition>());
+            mCamera.centerOn(p.x(), p.y());
+        }
+    }
+    
+    // How far an entity moved during the last tick.
+    Vector2f motionOf(const Entity& entity) const {
+        if (!entity.hasComponent<CLinearPhysics>()) return Vector2f();
+        
+        auto& physics(entity.getComponent<CLinearPhysics>());
+        return Vector2f(physics.x() - physics.mPrevious.x, physics.y() - physics.mPrevious.y);
+    }
+    
+    // Level of detail for updates: destroyable entities far from every
+    // player are updated every second or fourth tick only. Torpedoes and
+    // the players' ships are always updated every tick. Only the active
+    // entities are looked at, so sleeping ones cost nothing.
+    //
+    // What a slower entity updates late is what it draws, so anything in
+    // view, or that the camera can pan into view before the next schedule,
+    // is updated every tick wherever the players are. Nothing simulated
+    // depends on the interval, so the view deciding it keeps ticks
+    // deterministic.
+    void scheduleUpdates() {
+        auto& players(mManager.getEntitiesByGroup(EG_HUMANSPACESHIP));
+        auto& active(mManager.getActiveEntities());
+        float margin = LOD_VIEW_MARGIN + CAMERA_PAN_SPEED * LOD_SCHEDULE_TICKS / mTicksPerSecond;
+        
+        for (std::size_t i = 0; i < active.size(); i++) {
+            if (!active[i]->hasGroup(EG_DESTROYABLE)) continue;
+            auto& p(active[i]->getComponent<CPosition>());
+            
+            if (mCamera.isVisible(p.x() - margin, p.y() - margin, p.x() + margin, p.y() + margin)) {
+                active[i]->setUpdateInterval(1);
+                continue;
+            }
+            
+            float nearest = std::numeric_limits<float>::max();
+            for (auto& player : players) {
+                auto& pp(player->getComponent<CPosition>());
+                float dx = pp.x() - p.x();
+                float dy = pp.y() - p.y();
+                nearest = std::min(nearest, dx * dx + dy * dy);
+            }
+            
+            std::uint16_t interval = 1;
+            if (nearest > LOD_FAR_DISTANCE * LOD_FAR_DISTANCE) interval = 4;
+            else if (nearest > LOD_NEAR_DISTANCE * LOD_NEAR_DISTANCE) interval = 2;
+            active[i]->setUpdateInterval(interval, static_cast<std::uint16_t>(i));
+        }
+    }
+    
+    // The chunks a camera following a player would show, and
+    // CHUNK_ACTIVE_MARGIN around them, are simulated; the rest of the world
+    // is frozen. That view is the same on every peer and in a replay. On
+    // its own, the game also keeps what the camera shows live, wherever it
+    // was panned to; nothing else has to agree with it then. Chunks a
+    // little further out are loaded in the background, so they are ready
+    // by the time they are needed. Paging writes and frees chunk blobs, so
+    // it may allocate.
+    //
+    // Torpedoes are never frozen: they fly on until they leave the world
+    // or their lifetime ends.
+    void streamChunks() {
+        AllocTracker::ColdRegion cold;
+        AllocTracker::Scope tag(AllocTracker::TAG_STREAMING);
+        
+        mChunksActive.assign(mChunks->count(), false);
+        mChunksNearby.assign(mChunks->count(), false);
+        auto markView = [this](const Camera& view) {
+            float active = CHUNK_ACTIVE_MARGIN;
+            float nearby = CHUNK_ACTIVE_MARGIN + CHUNK_SIZE;
+            mChunks->markRect(view.left() - active, view.top() - active,
+                              view.right() + active, view.bottom() + active, mChunksActive);
+            mChunks->markRect(view.left() - nearby, view.top() - nearby,
+                              view.right() + nearby, view.bottom() + nearby, mChunksNearby);
+        };
+        
+        for (auto& player : mManager.getEntitiesByGroup(EG_HUMANSPACESHIP)) {
+            auto& p(player->getComponent<CPosition>());
+            Camera view(mCamera);
+            view.centerOn(p.x(), p.y());
+            markView(view);
+        }
+        if (!mLockstep && !mReplayRecorder && !mReplayPlayer) markView(mCamera);
+        
+        std::size_t pagedIn = mChunks->stats().pagedIn;
+        mChunks->stream(mManager, mChunksActive, [](const Entity& entity, float& x, float& y) {
+            if (entity.hasGroup(EG_HUMANSPACESHIP) || entity.hasGroup(EG_PHOTONTORPEDO)) return false;
+            if (!entity.hasComponent<CPosition>()) return false;
+            
+            auto& p(entity.getComponent<CPosition>());
+            x = p.x();
+            y = p.y();
+            return true;
+        });
+        if (mChunks->stats().pagedIn != pagedIn) scheduleTimers();
+        mChunks->prefetch(mChunksNearby);
+    }
+    
+    // Sets the timers of entities that come back from a snapshot or a
+    // chunk, which do not store them. Timers already set stay as they are.
+    void scheduleTimers() {
+        for (auto& animated : mManager.view<CSpriteAnimation>()) {
+            animated.get<CSpriteAnimation>().scheduleEnd();
+        }
+        for (auto& mortal : mManager.view<CLifetime>()) {
+            mortal.get<CLifetime>().scheduleEnd();
+        }
     }
     
     void update(float seconds) {
+        mAnimations.advance(mTick);
+        // Handled as they fire, before streaming or a refresh can free
+        // their entities.
+        mTimers.advance(mTick, [](const TimerEvent& expired) {
+            switch (expired.kind) {
+                case TIMER_LIFETIME:
+                    expired.entity->destroy();
+                    break;
+            }
+        });
+        
+        if (mTick % CHUNK_STREAM_TICKS == 0) {
+            streamChunks();
+        }
+        
         mManager.refresh();
+        
+        if (mTick % LOD_SCHEDULE_TICKS == 0) {
+            scheduleUpdates();
+        }
+        
+        integrateBodies( seconds );
+        updateAI( seconds );
         mManager.update( seconds );
     }
     
+    // The AI ships: a slice of the pilots picks targets, then all of them
+    // turn and fire. Without pilots they only spin.
+    void updateAI(float seconds) {
+        auto start(std::chrono::high_resolution_clock::now());
+        if (mAIPilots) thinkAI();
+        auto thought(std::chrono::high_resolution_clock::now());
+        actAI(seconds);
+        
+        mAITimes.think = std::chrono::duration<double>(thought - start).count();
+        mAITimes.act = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - thought).count();
+    }
+    
+    // Up to mAIThinkBudget pilots, taken round robin from mAICursor, look
+    // for the nearest player or asteroid. The others keep their target.
+    void thinkAI() {
+        auto& pilots(mManager.view<CPosition, CDirection, CInputAI>());
+        if (pilots.empty()) return;
+        
+        TargetGrid& targets(mAI->targets());
+        targets.reset(1.0f * mWorldWidth, 1.0f * mWorldHeight, AI_SENSOR_RANGE);
+        for (auto group : {EG_HUMANSPACESHIP, EG_ASTEROID}) {
+            for (auto& e : mManager.getEntitiesByGroup(group)) {
+                auto& p(e->getComponent<CPosition>());
+                targets.add(p.x(), p.y());
+            }
+        }
+        targets.build();
+        
+        std::size_t count = pilots.size();
+        std::size_t slice = mAIThinkBudget < count ? mAIThinkBudget : count;
+        std::size_t first = mAICursor % count;
+        
+        mAI->beginThink(slice);
+        for (std::size_t i = 0; i < slice; i++) {
+            auto& p(pilots[(first + i) % count].get<CPosition>());
+            mAI->setThinker(i, p.x(), p.y());
+        }
+        mAI->think(AI_SENSOR_RANGE);
+        
+        for (std::size_t i = 0; i < slice; i++) {
+            auto& ai(pilots[(first + i) % count].get<CInputAI>());
+            ai.mHasTarget = mAI->decided(i);
+            if (ai.mHasTarget) {
+                ai.mTargetX = mAI->decisionX(i);
+                ai.mTargetY = mAI->decisionY(i);
+                ai.entity->wake();
+            }
+        }
+        mAICursor = static_cast<Uint32>((first + slice) % count);
+    }
+    
+    void actAI(float seconds) {
+        mAIActors.clear();
+        for (auto& pilot : mManager.view<CPosition, CDirection, CInputAI>()) {
+            if (!pilot.entity->isSleeping()) mAIActors.push_back(&pilot.get<CInputAI>());
+        }
+        
+        mAI->beginAct(mAIActors.size());
+        for (std::size_t i = 0; i < mAIActors.size(); i++) {
+            const CInputAI& ai(*mAIActors[i]);
+            mAI->setActor(i, ai.mPosition->x(), ai.mPosition->y(), ai.mDirection->angle(), ai.mAngleSpeedPerSec,
+                          ai.mHasTarget, ai.mTargetX, ai.mTargetY, ai.mCooldown);
+        }
+        
+        const AIHandling handling{AI_SENSOR_RANGE, AI_TURN_RATE, AI_FIRE_RANGE, AI_FIRE_CONE, AI_FIRE_INTERVAL};
+        mAI->act(seconds, handling);
+        
+        for (std::size_t i = 0; i < mAIActors.size(); i++) {
+            CInputAI& ai(*mAIActors[i]);
+            ai.mDirection->setAngle(mAI->angle(i));
+            
+            // The sprite follows every turn, whatever the ship's update
+            // interval, so what is drawn is what collides and fires.
+            ai.mSprite->update(0.0f);
+            ai.mCooldown = mAI->cooldown(i);
+            if (mAI->fires(i)) fireAI(ai);
+            
+            // A ship with no target and no spin is parked until thinkAI
+            // finds it one or something hits it.
+            if (!ai.mHasTarget && ai.mAngleSpeedPerSec == 0.0f) ai.entity->sleep();
+        }
+    }
+    
+    // AI ships fire from just ahead of their nose, clear of their own box.
+    void fireAI(const CInputAI& ai) {
+        float angle = ai.mDirection->angle();
+        float angleRad = angle * (M_PI / 180.0);
+        createPhotonTorpedo(ai.mPosition->x() + std::sin(angleRad) * AI_MUZZLE_OFFSET,
+                            ai.mPosition->y() - std::cos(angleRad) * AI_MUZZLE_OFFSET, angle);
+        if (!mResimulating && isOnScreen(*ai.entity)) mSoundSystem->playFire();
+    }
+    
+    // Moves every entity with CLinearPhysics in one batched pass. The
+    // bodies are gathered into structure-of-arrays form and written back.
+    void integrateBodies(float seconds) {
+        mBodies.clear();
+        for (auto& body : mManager.view<CPosition, CDirection, CLinearPhysics>()) {
+            if (!body.entity->isSleeping()) mBodies.push_back(&body.get<CLinearPhysics>());
+        }
+        
+        mKinematics.resize(mBodies.size());
+        for (std::size_t i = 0; i < mBodies.size(); i++) {
+            const CLinearPhysics& body(*mBodies[i]);
+            mKinematics.set(i, body.x(), body.y(), body.mVelocity.x, body.mVelocity.y, body.mSpeed);
+        }
+        
+        mKinematics.integrate(seconds, mPrecision);
+        
+        for (std::size_t i = 0; i < mBodies.size(); i++) {
+            CLinearPhysics& body(*mBodies[i]);
+            body.mPrevious = body.mPosition->position;
+            body.mPosition->position = Vector2f{mKinematics.x(i), mKinematics.y(i)};
+            body.mVelocity = Vector2f{mKinematics.vx(i), mKinematics.vy(i)};
+            body.mDirection->setAngle(mKinematics.heading(i));
+        }
+    }
+    
 protected:
-    EntitySystem::Entity& createHumanSpaceship()
+    Entity& createHumanSpaceship(int player)
     {
         auto& entity(mManager.addEntity());
-        entity.addComponent<CPosition>(Vector2f{100.0, mWindowHeight/2.0f});
+        // The players start either side of the black hole, as far from
+        // it as the edges of the old single-screen world were.
+        float posX = mWorldWidth/2.0f + (player == 0 ? -412.0f : 412.0f);
+        entity.addComponent<CPosition>(Vector2f{posX, mWorldHeight/2.0f});
         entity.addComponent<CDirection>();
-        CLinearPhysics::Bound boundX{20.0f,1.0f*mWindowWidth-20};
-        CLinearPhysics::Bound boundY{20.0f,1.0f*mWindowHeight-20};
     
         entity.addComponent<CCollisionBox>(Vector2f(40,50));
-        entity.addComponent<CSprite>(mSpaceshipBlue->createSprite(22, 46, 700, 900), 20, 25);
+        entity.addComponent<CSprite>(*mPlayerSprite, 20, 25, mCamera);
         
         // Human controlled
         // This class is currently buggy! TO FIX!
-        entity.addComponent<CInputHuman>(this, 240.0);
+        entity.addComponent<CInputHuman>(this, 240.0, player);
         
         entity.addGroup(EntityGroups::EG_HUMANSPACESHIP);
         
         return entity;
     }
     
-    EntitySystem::Entity& createAISpaceship(int posX, int posY, float rotationSpeed)
+    // AI ships and asteroids are prefabs too, so the world can be spawned
+    // in bulk with Manager::spawnBatch. The build functions set up what all
+    // of them share, and the place functions what varies.
+    Entity& createAISpaceship(int posX, int posY, float rotationSpeed)
     {
-        auto& entity(mManager.addEntity());
-        entity.addComponent<CPosition>(Vector2f{1.0f*posX, 1.0f*posY});
-        entity.addComponent<CDirection>();
+        auto& entity(mManager.spawn(mAISpaceshipPrefab));
+        placeAISpaceship(entity, posX, posY, rotationSpeed);
+        return entity;
+    }
+    
+    void buildAISpaceship(Entity& entity)
+    {
+        entity.addComponent<CPosition>();
+        entity.addComponent<CDirection>(0.0f);
         Vector2f halfSize{10,10};
-        entity.addComponent<CCollisionBox>(Vector2f(halfSize.x,halfSize.y));
-        entity.addComponent<CSprite>(mSpaceshipSS->createSprite(840, 0, 610, 530), 2*halfSize.x, 2*halfSize.y);
+        entity.addComponent<CCollisionBox>(Vector2f(halfSize.x,halfSize.y), mAISpaceshipMasks.get());
+        entity.addComponent<CSprite>(*mAISpaceshipSprite, 2*halfSize.x, 2*halfSize.y, mCamera);
 
-        entity.addComponent<CInputAI>(rotationSpeed);
+        entity.addComponent<CInputAI>();
         
         entity.addGroup(EntityGroups::EG_SPACESHIP);
         entity.addGroup(EntityGroups::EG_DESTROYABLE);
-        
+    }
+    
+    void placeAISpaceship(Entity& entity, int posX, int posY, float rotationSpeed)
+    {
+        entity.getComponent<CPosition>().position = Vector2f{1.0f*posX, 1.0f*posY};
+        entity.getComponent<CDirection>().setAngle(0.0f);
+        entity.getComponent<CInputAI>().mAngleSpeedPerSec = rotationSpeed;
+        entity.getComponent<CSprite>().update(0.0);
+    }
+    
+    Entity& createAsteroid(int posX, int posY)
+    {
+        auto& entity(mManager.spawn(mAsteroidPrefab));
+        placeAsteroid(entity, posX, posY);
         return entity;
     }
     
-    EntitySystem::Entity& createAsteroid(int posX, int posY)
+    void buildAsteroid(Entity& entity)
     {
-        auto& entity(mManager.addEntity());
-        entity.addComponent<CPosition>(Vector2f{1.0f*posX, 1.0f*posY});
-        entity.addComponent<CDirection>();
+        entity.addComponent<CPosition>();
+        entity.addComponent<CDirection>(0.0f);
         Vector2f halfSize{20,20};
-        entity.addComponent<CCollisionBox>(Vector2f(halfSize.x,halfSize.y));
-        entity.addComponent<CSpriteAnimation>(mAsteroidAnimation, 40, 40, 2, false);
+        entity.addComponent<CCollisionBox>(Vector2f(halfSize.x,halfSize.y), mAsteroidMasks.get());
+        entity.addComponent<CSpriteAnimation>(mAnimations, mAsteroidTimeline, mCamera, 40, 40);
 
         entity.addGroup(EntityGroups::EG_ASTEROID);
         entity.addGroup(EntityGroups::EG_DESTROYABLE);
+    }
+    
+    void placeAsteroid(Entity& entity, int posX, int posY)
+    {
+        entity.getComponent<CPosition>().position = Vector2f{1.0f*posX, 1.0f*posY};
         
-        return entity;
+        auto& animation(entity.getComponent<CSpriteAnimation>());
+        animation.play();
+        animation.update(0.0f);
+        
+        // Asteroids never move, and the clip plays from the tick alone, so
+        // there is nothing to update until something hits them.
+        entity.sleep();
     }
     
-    EntitySystem::Entity& createPhotonTorpedo(int posX, int posY, float angle)
+    // Torpedoes come and go with every shot, so they are recycled through a
+    // prefab pool: this builds the components once, and createPhotonTorpedo
+    // only resets their state.
+    void buildPhotonTorpedo(Entity& entity)
     {
-        auto& entity(mManager.addEntity());
-        entity.addComponent<CPosition>(Vector2f{1.0f*posX, 1.0f*posY});
-        entity.addComponent<CDirection>(angle);
+        entity.addComponent<CPosition>();
+        entity.addComponent<CDirection>(0.0f);
+        
+        Vector2f halfSize{TORPEDO_HALF_WIDTH,TORPEDO_HALF_HEIGHT};
+        float margin = TORPEDO_BOUNDS_MARGIN;   // std::pair takes references
+        CLinearPhysics::Bound boundX{margin,1.0f*mWorldWidth-margin};
+        CLinearPhysics::Bound boundY{margin,1.0f*mWorldHeight-margin};
+        
+        entity.addComponent<CLinearPhysics>(Vector2f{0.0f, -1.0f},halfSize,boundX,boundY,&mEvents);
+        entity.addComponent<CCollisionBox>(Vector2f(halfSize.x,halfSize.y), mTorpedoMasks.get());
+        entity.addComponent<CSprite>(*mTorpedoSprite, halfSize.x*2.0, halfSize.y*2.0, mCamera);
+        entity.addComponent<CLifetime>(mTimers);
+        
+        entity.addGroup(EntityGroups::EG_PHOTONTORPEDO);
+    }
+    
+    Entity& createPhotonTorpedo(int posX, int posY, float angle)
+    {
+        auto& entity(mManager.spawn(mTorpedoPrefab));
+        entity.getComponent<CPosition>().position = Vector2f{1.0f*posX, 1.0f*posY};
+        entity.getComponent<CLinearPhysics>().mPrevious = Vector2f{1.0f*posX, 1.0f*posY};
+        entity.getComponent<CDirection>().setAngle(angle);
         
         // This shouldn't be needed. Should be able to specify it using just {}
-        float speed = 250.0f;
+        float speed = TORPEDO_SPEED;
         
         float angleRad = angle * (M_PI / 180.0);
-        Vector2f velocity{ std::sin(angleRad) * speed, -std::cos(angleRad) * speed };
-        Vector2f halfSize{2.0,6.0};
-        CLinearPhysics::Bound boundX{20.0f,1.0f*mWindowWidth-20};
-        CLinearPhysics::Bound boundY{20.0f,1.0f*mWindowHeight-20};
-        
-        entity.addComponent<CLinearPhysics>(velocity,halfSize,boundX,boundY);
-        entity.addComponent<CCollisionBox>(Vector2f(halfSize.x,halfSize.y));
-        entity.addComponent<CSprite>(mPhotonSS->createSprite(0, 0, 28, 86), halfSize.x*2.0, halfSize.y*2.0);
-
-        auto& cPhysics(entity.getComponent<CLinearPhysics>());
+        entity.getComponent<CLinearPhysics>().setVelocity({ std::sin(angleRad) * speed, -std::cos(angleRad) * speed });
+        entity.getComponent<CSprite>().update(0.0);
+        entity.getComponent<CSprite>().mTrace = nullptr;
         
-        cPhysics.onOutOfBounds = [&cPhysics](const Vector2f& mSide)
-        {
-            cPhysics.entity->destroy();
-        };
-        
-        entity.addGroup(EntityGroups::EG_PHOTONTORPEDO);
+        // A torpedo caught by the black hole could orbit it for ever.
+        Uint32 lifetime = static_cast<Uint32>(std::lround(TORPEDO_LIFETIME_SECONDS * mTicksPerSecond));
+        entity.getComponent<CLifetime>().start(mTick + lifetime);
         
         return entity;
     }
     
-    EntitySystem::Entity& createExplosion(int posX, int posY)
+    // Matches a shot of the local player to the fire key press behind it
+    // (see LatencyTrace); the torpedo reports its first draw. Shots fired
+    // again while resimulating were traced the first time.
+    void traceShot(Entity& torpedo, int player)
     {
-        auto& entity(mManager.addEntity());
-        entity.addComponent<CPosition>(Vector2f{1.0f*posX, 1.0f*posY});
+        int localPlayer = mLockstep ? mLockstep->localPlayer() : 0;
+        if (mResimulating || player != localPlayer) return;
         
-        entity.addComponent<CSpriteAnimation>(mExplosionAnimation, 60, 60, 2);
+        int shot = mLatency.fire(mTick);
+        if (shot == 0) return;
+        
+        auto& sprite(torpedo.getComponent<CSprite>());
+        sprite.mTrace = &mLatency;
+        sprite.mTraceShot = shot;
+    }
+    
+    // Snapshots only store component state, so restoring a world recreates
+    // each entity from the factory matching its groups.
+    Entity& createEntityForGroups(const Entity::GroupBitset& groups)
+    {
+        if (groups[EG_HUMANSPACESHIP]) return createHumanSpaceship(0);
+        if (groups[EG_SPACESHIP]) return createAISpaceship(0, 0, 0.0f);
+        if (groups[EG_ASTEROID]) return createAsteroid(0, 0);
+        if (groups[EG_PHOTONTORPEDO]) return createPhotonTorpedo(0, 0, 0.0f);
         
-        entity.addGroup(EntityGroups::EG_EXPLOSION);
+        throw std::runtime_error("Snapshot contains an entity of an unknown kind.");
+    }
+    
+    // Rebuilds an entity frozen with its chunk. This runs on the chunk
+    // loader thread, so it only builds into `staging` and reads resources
+    // that were set up by the constructor.
+    Entity& createFrozenEntity(Manager& staging, const Entity::GroupBitset& groups)
+    {
+        auto& entity(staging.addEntity());
+        if (groups[EG_SPACESHIP]) buildAISpaceship(entity);
+        else if (groups[EG_ASTEROID]) buildAsteroid(entity);
+        else if (groups[EG_PHOTONTORPEDO]) buildPhotonTorpedo(entity);
+        else throw std::runtime_error("Chunk contains an entity of an unknown kind.");
         
         return entity;
     }
     
+    // Explosions are purely visual, so they are particles rather than entities.
+    void createExplosion(float x, float y)
+    {
+        if (mResimulating) return;
+        
+        mParticles.emit(mExplosionStyle, x, y, 0.0f, 0.0f);
+        mParticles.burst(mDebrisStyle, x, y, 24, 120.0f);
+    }
+    
+    // Torpedoes leave a short trail behind them. This runs after the
+    // tick's events, so torpedoes that just hit something or left the
+    // world are still in the view, but dead.
+    void emitExhaust()
+    {
+        for (auto& body : mManager.view<CPosition, CLinearPhysics>()) {
+            if (!body.entity->isAlive()) continue;
+            
+            auto& pp(body.get<CPosition>());
+            auto& plp(body.get<CLinearPhysics>());
+            mParticles.emit(mExhaustStyle, pp.x(), pp.y(), -0.1f * plp.mVelocity.x, -0.1f * plp.mVelocity.y);
+        }
+    }
+    
     
 private:
+    static constexpr Uint32 MIN_TICKS_PER_SECOND = 10;
+    static constexpr Uint32 MAX_TICKS_PER_SECOND = 240;
+    static constexpr Uint32 SNAPSHOT_MAGIC = 0x4E534842; // "BHSN"
+    static constexpr Uint32 SNAPSHOT_VERSION = 10;
+    static constexpr Uint32 MAX_CATCHUP_TICKS = 8;
+    static constexpr Uint32 NET_CONNECT_TIMEOUT_MS = 60000;
+    static constexpr Uint32 LOCKSTEP_REPORT_SECONDS = 5;
+    static constexpr std::size_t PARTICLE_CAPACITY = 65536;
+    static constexpr std::size_t TORPEDO_POOL_SIZE = 128;
+    static constexpr Uint32 LOD_SCHEDULE_TICKS = 15;
+    static constexpr float LOD_NEAR_DISTANCE = 250.0f;
+    static constexpr float LOD_FAR_DISTANCE = 500.0f;
+    static constexpr float LOD_VIEW_MARGIN = 64.0f;      // more than the largest half size
+    static constexpr int WORLD_WIDTH = 3072;
+    static constexpr int WORLD_HEIGHT = 2304;
+    static constexpr int WORLD_POPULATION = 225;
+    static constexpr float BLACK_HOLE_ATTRACTION = 5000000.0f;
+    static constexpr float TORPEDO_SPEED = 250.0f;
+    static constexpr float TORPEDO_HALF_WIDTH = 2.0f;
+    static constexpr float TORPEDO_HALF_HEIGHT = 6.0f;
+    static constexpr float TORPEDO_BOUNDS_MARGIN = 20.0f;
+    static constexpr float TORPEDO_LIFETIME_SECONDS = 4.0f;    // at least TRAJECTORY_SECONDS
+    static constexpr float TRAJECTORY_SECONDS = 3.0f;
+    static constexpr float TRAJECTORY_LANE_SPACING = 2.0f;
+    static constexpr Uint32 TRAJECTORY_MAX_AGE = 15;
+    static constexpr int TRAJECTORY_DOT_TICKS = 4;
+    static constexpr float CAMERA_PAN_SPEED = 600.0f;
+    static constexpr float CHUNK_SIZE = 384.0f;
+    static constexpr float CHUNK_ACTIVE_MARGIN = 128.0f;
+    static constexpr Uint32 CHUNK_STREAM_TICKS = 15;
+    static constexpr Uint32 ALLOC_TEST_SEED = 12345;
+    static constexpr Uint32 ALLOC_TEST_WARMUP_TICKS = 600;
+    static constexpr Uint32 ALLOC_TEST_TICKS = 1200;
+    static constexpr Uint32 SPRITE_BENCHMARK_SEED = 4321;
+    static constexpr std::size_t FRAME_CAPTURE_SLOTS = 8;
+    static constexpr int LENSING_RADIUS = 160;
+    static constexpr float LENSING_HORIZON = 0.12f;
+    static constexpr float LENSING_STRENGTH = 0.3f;
+    static constexpr unsigned LENSING_MAX_THREADS = 4;
+    static constexpr double LENSING_BUDGET_MS = 1.0;
+    static constexpr int LENSING_BENCHMARK_FRAMES = 500;
+    static constexpr int MASK_ROTATION_STEPS = 64;
+    static constexpr int MASK_MAX_SAMPLES = 16;
+    static constexpr int SPRITE_BENCHMARK_DRAWS = 20000;
+    static constexpr int SPRITE_BENCHMARK_SAMPLES = 360;
+    static constexpr float AI_SENSOR_RANGE = 300.0f;
+    static constexpr float AI_TURN_RATE = 90.0f;
+    static constexpr float AI_FIRE_RANGE = 250.0f;
+    static constexpr float AI_FIRE_CONE = 4.0f;
+    static constexpr float AI_FIRE_INTERVAL = 2.0f;
+    static constexpr float AI_MUZZLE_OFFSET = 20.0f;
+    static constexpr Uint32 AI_BENCHMARK_SEED = 2468;
+    static constexpr int AI_BENCHMARK_FLEET = 4000;
+    static constexpr Uint32 AI_BENCHMARK_TICKS = 600;
+    static constexpr double AI_BUDGET_MS = 1.0;
+    static constexpr Uint32 SPAWN_BENCHMARK_SEED = 1357;
+    static constexpr std::size_t SPAWN_BENCHMARK_COUNT = 100000;
+    static constexpr std::uint64_t SPAWN_BENCHMARK_SLACK = 64;     // the lists and the slab
+    static constexpr double SPAWN_BUDGET_MS = 250.0;
+    static constexpr double HUD_REFRESH_SECONDS = 0.25;
+    static constexpr int HUD_SCALE = 2;
+    static constexpr int HUD_MARGIN = 8;
+    static constexpr std::size_t HUD_TEXT_SIZE = 512;
+    
     int mWindowWidth{1024};
     int mWindowHeight{768};
+    int mWorldWidth{WORLD_WIDTH};
+    int mWorldHeight{WORLD_HEIGHT};
+    Camera mCamera{1.0f*mWindowWidth, 1.0f*mWindowHeight, 1.0f*mWorldWidth, 1.0f*mWorldHeight};
+    bool mCameraFollows{true};
     Window* mWindow;
     Renderer* mRenderer;
     bool mIsRunning;
@@ -722,11 +2678,107 @@ private:
     std::shared_ptr<Texture> mBackground;
     std::shared_ptr<SpriteAnimation> mExplosionAnimation;
     std::shared_ptr<SpriteAnimation> mAsteroidAnimation;
+    
+    // Shared by every entity drawn with them, and with their rotation
+    // caches if there are any.
+    std::unique_ptr<Sprite> mPlayerSprite;
+    std::unique_ptr<Sprite> mAISpaceshipSprite;
+    std::unique_ptr<Sprite> mTorpedoSprite;
+    
+    std::unique_ptr<LensingEffect> mLensing;
+    std::unique_ptr<TrajectoryPreview> mTrajectory;
+    std::vector<TrajectoryObstacle> mTrajectoryObstacles;
+    std::vector<SDL_Rect> mTrajectoryDots;
+    Uint32 mTrajectoryTick{0};      // when the preview was last integrated
+    std::unique_ptr<FrameCapture> mCapture;
+    
+    // The performance HUD (F3): its text, the panel behind it, and what
+    // the frames since it was last laid out measured.
+    struct HudSamples {
+        Uint32 frames{0};
+        double seconds{0.0};
+        double worstSeconds{0.0};
+        Uint64 ticks{0};
+        Uint64 drawCalls{0};
+        Uint64 allocations{0};
+    };
+    std::unique_ptr<TextBatch> mHud;
+    bool mHudVisible{false};
+    char mHudText[HUD_TEXT_SIZE]{};
+    SDL_Rect mHudPanel{0, 0, 0, 0};
+    HudSamples mHudSamples;
+    
+    // Key press to present latency of the local player's shots.
+    LatencyTrace mLatency;
+    
+    // Pixel collisions only.
+    bool mPixelCollisions{false};
+    std::unique_ptr<CollisionMasks> mAISpaceshipMasks;
+    std::unique_ptr<CollisionMasks> mAsteroidMasks;
+    std::unique_ptr<CollisionMasks> mTorpedoMasks;
+    
+    AnimationTimelines mAnimations;
+    AnimationTimelines::TimelineID mAsteroidTimeline;
+    
+    ParticleSystem mParticles{PARTICLE_CAPACITY};
+    ParticleSystem::StyleID mExplosionStyle;
+    ParticleSystem::StyleID mDebrisStyle;
+    ParticleSystem::StyleID mExhaustStyle;
 
     
-    EntitySystem::Manager mManager;
+    // Before the manager, whose components cancel their timers when they
+    // are destroyed.
+    GameTimers mTimers;
+    
+    Manager mManager;
+    EntitySystem::PrefabID mTorpedoPrefab;
+    EntitySystem::PrefabID mAISpaceshipPrefab;
+    EntitySystem::PrefabID mAsteroidPrefab;
+    std::unique_ptr<Chunks> mChunks;
+    std::vector<bool> mChunksActive, mChunksNearby;     // kept for their capacity
+    GameEvents mEvents;
+    
+    KinematicsBatch mKinematics;
+    std::vector<CLinearPhysics*> mBodies;
+    Kinematics::Precision mPrecision{Kinematics::Precision::Exact};
+    
+    std::unique_ptr<AIPilots> mAI;
+    bool mAIPilots{false};
+    std::size_t mAIThinkBudget{1};
+    Uint32 mAICursor{0};            // the next pilot to think
+    std::vector<CInputAI*> mAIActors;
+    AITimes mAITimes;
     
     SoundSystem* mSoundSystem;
+    
+    // Determinism: every spawn derives from mSeed, and the only other
+    // input to the simulation is mInput, one frame per tick.
+    Uint32 mSeed;
+    Uint32 mTick{0};
+    Uint32 mTicksPerSecond{60};
+    InputFrame mInput;
+    bool mInputConsumed{true};
+    
+    // The inputs the current tick is simulated with, one per player.
+    InputFrame mPlayerInputs[LockstepSession::kNumPlayers];
+    
+    std::unique_ptr<LockstepSession> mLockstep;
+    std::array<std::vector<Uint8>, 2 * LockstepSession::kMaxPrediction> mRollbackSnapshots;
+    std::array<Chunks::Table, 2 * LockstepSession::kMaxPrediction> mRollbackChunks;
+    bool mResimulating{false};
+    std::unique_ptr<ReplayRecorder> mReplayRecorder;
+    std::unique_ptr<ReplayPlayer> mReplayPlayer;
+    
+    std::vector<Uint8> mQuickSave;
+    std::vector<Uint8> mCheckpoint;
+    std::unique_ptr<CheckpointWriter> mCheckpointWriter;
+    Uint32 mCheckpointInterval{1};
+    
+    bool mAllocReport{false};
+    AllocTracker::HotPolicy mAllocHotPolicy{AllocTracker::HotPolicy::Ignore};
+    Uint64 mAllocFrames{0};
+    AllocTracker::Frame mAllocTotals;
+    AllocTracker::Frame mAllocWorst;
 };
 
 #endif
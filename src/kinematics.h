@@ -0,0 +1,201 @@
+#ifndef BlackHole_kinematics_h
+#define BlackHole_kinematics_h
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Kinematics {
+    // Exact uses the std:: functions and gives the same results as the
+    // per-component code it replaces. Fast uses a refined reciprocal square
+    // root (relative error below 1e-6) and a polynomial atan2 (absolute
+    // error below 1e-5 radians, i.e. well under a thousandth of a degree).
+    enum class Precision {
+        Exact,
+        Fast
+    };
+
+    // Wraps an angle in degrees into [0, 360] without looping (only tiny
+    // negative angles round up to 360). This divides rather than multiplying
+    // by 1/360, since the rounded reciprocal would put angles just below 360
+    // on the wrong side of the floor.
+    inline float wrapDegrees(float degrees) {
+        return degrees - 360.0f * std::floor(degrees / 360.0f);
+    }
+
+    // atan2 on [-pi, pi] from a minimax polynomial for atan on [0, 1].
+    inline float fastAtan2(float y, float x) {
+        float ax = std::fabs(x), ay = std::fabs(y);
+        float mx = std::fmax(ax, ay), mn = std::fmin(ax, ay);
+        float a = mn / std::fmax(mx, 1e-30f);
+        float s = a * a;
+        float r = ((((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s
+                      + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a);
+        if (ay > ax) r = 1.57079637f - r;
+        if (x < 0.0f) r = 3.14159274f - r;
+        return std::copysign(r, y);
+    }
+}
+
+// Moves bodies along their velocity in one pass over structure-of-arrays
+// data. The velocity of a body is first scaled back to its speed (gravity
+// bends it without changing the speed), then the position is integrated
+// and the heading derived from the velocity, in degrees with 0 pointing up.
+class KinematicsBatch {
+public:
+    void resize(std::size_t count) {
+        mCount = count;
+
+        // Round up so the SIMD loop never needs a scalar tail. The vectors
+        // never shrink, so a steady body count does not reallocate.
+        std::size_t padded = (count + 3) & ~std::size_t(3);
+        if (padded > mX.size()) {
+            for (auto* v : {&mX, &mY, &mVX, &mVY, &mSpeed, &mHeading}) {
+                v->resize(padded, 0.0f);
+            }
+        }
+    }
+
+    std::size_t size() const { return mCount; }
+
+    // Makes room for `count` bodies, so resizing up to that does not allocate.
+    void reserve(std::size_t count) {
+        std::size_t padded = (count + 3) & ~std::size_t(3);
+        for (auto* v : {&mX, &mY, &mVX, &mVY, &mSpeed, &mHeading}) {
+            v->reserve(padded);
+        }
+    }
+
+    void set(std::size_t i, float x, float y, float vx, float vy, float speed) {
+        mX[i] = x;
+        mY[i] = y;
+        mVX[i] = vx;
+        mVY[i] = vy;
+        mSpeed[i] = speed;
+    }
+
+    float x(std::size_t i) const { return mX[i]; }
+    float y(std::size_t i) const { return mY[i]; }
+    float vx(std::size_t i) const { return mVX[i]; }
+    float vy(std::size_t i) const { return mVY[i]; }
+    float heading(std::size_t i) const { return mHeading[i]; }
+
+    void integrate(float ft, Kinematics::Precision precision) {
+        if (precision == Kinematics::Precision::Fast) {
+            integrateFast(ft);
+        } else {
+            integrateExact(ft);
+        }
+    }
+
+private:
+    void integrateExact(float ft) {
+#if defined(__SSE2__)
+        // Same operations in the same order as the scalar code, and SSE
+        // sqrt and division are correctly rounded, so the results match it
+        // bit for bit.
+        const __m128 dt = _mm_set1_ps(ft);
+        for (std::size_t i = 0; i < mCount; i += 4) {
+            __m128 vx = _mm_loadu_ps(&mVX[i]);
+            __m128 vy = _mm_loadu_ps(&mVY[i]);
+            __m128 speed = _mm_loadu_ps(&mSpeed[i]);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+            vx = _mm_mul_ps(_mm_div_ps(vx, length), speed);
+            vy = _mm_mul_ps(_mm_div_ps(vy, length), speed);
+
+            _mm_storeu_ps(&mVX[i], vx);
+            _mm_storeu_ps(&mVY[i], vy);
+            _mm_storeu_ps(&mX[i], _mm_add_ps(_mm_loadu_ps(&mX[i]), _mm_mul_ps(vx, dt)));
+            _mm_storeu_ps(&mY[i], _mm_add_ps(_mm_loadu_ps(&mY[i]), _mm_mul_ps(vy, dt)));
+        }
+#else
+        for (std::size_t i = 0; i < mCount; ++i) {
+            float length = std::sqrt(mVX[i] * mVX[i] + mVY[i] * mVY[i]);
+            mVX[i] = mVX[i] / length * mSpeed[i];
+            mVY[i] = mVY[i] / length * mSpeed[i];
+            mX[i] += mVX[i] * ft;
+            mY[i] += mVY[i] * ft;
+        }
+#endif
+
+        // SSE has no atan2, so the heading stays scalar.
+        for (std::size_t i = 0; i < mCount; ++i) {
+            float angleRad = std::atan2(mVY[i], mVX[i]);
+            float angleDeg = angleRad * 180.0 / M_PI;
+            mHeading[i] = angleDeg + 90;
+        }
+    }
+
+    void integrateFast(float ft) {
+        const float degrees = static_cast<float>(180.0 / M_PI);
+#if defined(__SSE2__)
+        const __m128 dt = _mm_set1_ps(ft);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 threeHalves = _mm_set1_ps(1.5f);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const __m128 tiny = _mm_set1_ps(1e-30f);
+        const __m128 halfPi = _mm_set1_ps(1.57079637f);
+        const __m128 pi = _mm_set1_ps(3.14159274f);
+        const __m128 toDegrees = _mm_set1_ps(degrees);
+        const __m128 quarterTurn = _mm_set1_ps(90.0f);
+
+        for (std::size_t i = 0; i < mCount; i += 4) {
+            __m128 vx = _mm_loadu_ps(&mVX[i]);
+            __m128 vy = _mm_loadu_ps(&mVY[i]);
+            __m128 speed = _mm_loadu_ps(&mSpeed[i]);
+
+            // 1/length from rsqrt plus one Newton-Raphson step
+            __m128 lengthSq = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy));
+            __m128 r = _mm_rsqrt_ps(lengthSq);
+            r = _mm_mul_ps(r, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, lengthSq), _mm_mul_ps(r, r))));
+            __m128 scale = _mm_mul_ps(r, speed);
+            vx = _mm_mul_ps(vx, scale);
+            vy = _mm_mul_ps(vy, scale);
+
+            _mm_storeu_ps(&mVX[i], vx);
+            _mm_storeu_ps(&mVY[i], vy);
+            _mm_storeu_ps(&mX[i], _mm_add_ps(_mm_loadu_ps(&mX[i]), _mm_mul_ps(vx, dt)));
+            _mm_storeu_ps(&mY[i], _mm_add_ps(_mm_loadu_ps(&mY[i]), _mm_mul_ps(vy, dt)));
+
+            // atan2, with the octant fix-ups done by masking
+            __m128 ax = _mm_andnot_ps(signBit, vx);
+            __m128 ay = _mm_andnot_ps(signBit, vy);
+            __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), tiny));
+            __m128 s = _mm_mul_ps(a, a);
+            __m128 p = _mm_set1_ps(-0.01172120f);
+            p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.05265332f));
+            p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.11643287f));
+            p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.19354346f));
+            p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.33262347f));
+            p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.99997726f));
+            __m128 angle = _mm_mul_ps(p, a);
+
+            __m128 steep = _mm_cmpgt_ps(ay, ax);
+            angle = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(halfPi, angle)), _mm_andnot_ps(steep, angle));
+            __m128 behind = _mm_cmplt_ps(vx, _mm_setzero_ps());
+            angle = _mm_or_ps(_mm_and_ps(behind, _mm_sub_ps(pi, angle)), _mm_andnot_ps(behind, angle));
+            angle = _mm_or_ps(angle, _mm_and_ps(signBit, vy));
+
+            _mm_storeu_ps(&mHeading[i], _mm_add_ps(_mm_mul_ps(angle, toDegrees), quarterTurn));
+        }
+#else
+        for (std::size_t i = 0; i < mCount; ++i) {
+            float scale = mSpeed[i] / std::sqrt(mVX[i] * mVX[i] + mVY[i] * mVY[i]);
+            mVX[i] *= scale;
+            mVY[i] *= scale;
+            mX[i] += mVX[i] * ft;
+            mY[i] += mVY[i] * ft;
+            mHeading[i] = Kinematics::fastAtan2(mVY[i], mVX[i]) * degrees + 90.0f;
+        }
+#endif
+    }
+
+    std::size_t mCount{0};
+    std::vector<float> mX, mY, mVX, mVY, mSpeed, mHeading;
+};
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef BlackHole_latencytrace_h
+#define BlackHole_latencytrace_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Measures how long a shot takes to show up: from the key press to the
+// SDL_RenderPresent of the first frame that draws its torpedo. Each shot
+// is followed through four stages:
+//
+// - queue:   the key event's timestamp until the game loop polls it,
+// - tick:    polled until a tick consumes the input and fires,
+// - draw:    fired until the torpedo's sprite is first drawn,
+// - present: drawn until the frame is presented.
+//
+// Presses wait in a FIFO until a tick fires them, so shots are matched to
+// presses in order. Everything lives in fixed arrays, so tracing does not
+// allocate; a shot whose torpedo never gets drawn (a rollback or a loaded
+// snapshot removed it) is counted as lost once its record is reused.
+//
+// SDL stamps events in milliseconds, so the queue stage is only as
+// precise as that; the other stages use the high resolution clock.
+class LatencyTrace {
+public:
+    enum Stage { STAGE_QUEUE, STAGE_TICK, STAGE_DRAW, STAGE_PRESENT, STAGE_TOTAL, STAGE_COUNT };
+
+    // Histograms have kBucketUs wide buckets, up to 200 ms; the last one
+    // also holds everything slower.
+    static constexpr int kBucketUs = 250;
+    static constexpr int kBuckets = 800;
+
+    LatencyTrace() = default;
+    LatencyTrace(const LatencyTrace&) = delete;
+    LatencyTrace& operator=(const LatencyTrace&) = delete;
+
+    // Also writes one CSV row per shot to `filename`.
+    void openLog(const std::string& filename) {
+        mLog.open(filename.c_str(), std::ios::trunc);
+        if (!mLog) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to open latency log for writing (" << filename << ")";
+            throw std::runtime_error(oss.str());
+        }
+        mLog << "shot,tick,queue_ms,tick_ms,draw_ms,present_ms,total_ms\n";
+    }
+
+    // A fire key press, with the SDL timestamp of its event. Called as the
+    // event is polled.
+    void press(Uint32 eventTimestamp) {
+        Clock::time_point now(Clock::now());
+        Uint32 age = SDL_GetTicks() - eventTimestamp;
+        if (age > kMaxEventAgeMs) age = 0;   // stamped by another clock
+
+        if (mPendingCount == kPending) {
+            // Nothing fires them; forget the oldest.
+            mPendingFirst = (mPendingFirst + 1) % kPending;
+            --mPendingCount;
+        }
+        Press& p(mPending[(mPendingFirst + mPendingCount) % kPending]);
+        p.event = now - std::chrono::milliseconds(age);
+        p.polled = now;
+        ++mPendingCount;
+    }
+
+    // A shot fired on `tick`. Returns the shot to pass to drawn(), or 0
+    // if there is no press waiting for it.
+    int fire(Uint32 tick) {
+        if (mPendingCount == 0) return 0;
+        const Press& p(mPending[mPendingFirst]);
+        mPendingFirst = (mPendingFirst + 1) % kPending;
+        --mPendingCount;
+
+        int slot = mNextShot;
+        mNextShot = (mNextShot + 1) % kInFlight;
+        Shot& shot(mShots[slot]);
+        if (shot.state != SHOT_FREE) ++mLost;
+
+        shot.state = SHOT_FIRED;
+        shot.tick = tick;
+        shot.times[0] = p.event;
+        shot.times[1] = p.polled;
+        shot.times[2] = Clock::now();
+        return slot + 1;
+    }
+
+    // The first draw of the shot's torpedo.
+    void drawn(int shot) {
+        Shot& s(mShots[shot - 1]);
+        if (s.state != SHOT_FIRED) return;
+        s.state = SHOT_DRAWN;
+        s.times[3] = Clock::now();
+        ++mDrawnCount;
+    }
+
+    // The frame was presented: completes the shots drawn in it.
+    void presented() {
+        if (mDrawnCount == 0) return;
+        Clock::time_point now(Clock::now());
+        for (Shot& s : mShots) {
+            if (s.state != SHOT_DRAWN) continue;
+            s.times[4] = now;
+            record(s);
+            s.state = SHOT_FREE;
+        }
+        mDrawnCount = 0;
+    }
+
+    Uint32 samples() const { return mSamples; }
+    Uint32 lost() const { return mLost; }
+
+    // An upper bound of the `fraction` quantile of a stage, in ms: the end
+    // of the bucket it falls in.
+    double percentile(Stage stage, double fraction) const {
+        if (mSamples == 0) return 0.0;
+        Uint32 rank = static_cast<Uint32>(std::ceil(fraction * mSamples));
+        Uint32 seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += mHistogram[stage][b];
+            if (seen >= std::max<Uint32>(rank, 1)) return std::min(bucketMs(b + 1), mWorstMs[stage]);
+        }
+        return mWorstMs[stage];
+    }
+
+    double meanMs(Stage stage) const { return mSamples ? mSumMs[stage] / mSamples : 0.0; }
+    double worstMs(Stage stage) const { return mWorstMs[stage]; }
+
+    // The stages, then the histogram of the total as rows of a bar chart.
+    void report(std::ostream& out) const {
+        static const char* const names[STAGE_COUNT] = { "queue", "tick", "draw", "present", "total" };
+
+        out << "Input latency over " << mSamples << " shots (key press to present), "
+            << mLost << " lost:" << std::endl;
+        if (mSamples == 0) return;
+
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            Stage stage = static_cast<Stage>(s);
+            out << "  " << names[s] << ": " << meanMs(stage) << " ms mean, " << percentile(stage, 0.5)
+                << " median, " << percentile(stage, 0.99) << " p99, " << worstMs(stage) << " worst" << std::endl;
+        }
+
+        Uint32 most = *std::max_element(mHistogram[STAGE_TOTAL], mHistogram[STAGE_TOTAL] + kBuckets);
+        for (int b = 0; b < kBuckets; ++b) {
+            Uint32 count = mHistogram[STAGE_TOTAL][b];
+            if (count == 0) continue;
+
+            out << "  " << bucketMs(b);
+            if (b == kBuckets - 1) out << "+";
+            else out << "-" << bucketMs(b + 1);
+            out << " ms " << std::string(1 + kBarWidth * (count - 1) / most, '#') << " " << count << std::endl;
+        }
+    }
+
+private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    static constexpr int kPending = 16;
+    static constexpr int kInFlight = 32;
+    static constexpr Uint32 kMaxEventAgeMs = 10000;
+    static constexpr Uint32 kBarWidth = 40;
+
+    struct Press {
+        Clock::time_point event, polled;
+    };
+
+    enum ShotState : Uint8 { SHOT_FREE, SHOT_FIRED, SHOT_DRAWN };
+
+    // times: event, polled, fired, drawn, presented; stage i ends at
+    // times[i + 1].
+    struct Shot {
+        ShotState state{SHOT_FREE};
+        Uint32 tick{0};
+        Clock::time_point times[STAGE_COUNT];
+    };
+
+    // Where bucket `b` starts.
+    static double bucketMs(int b) { return b * (kBucketUs / 1000.0); }
+
+    void record(const Shot& s) {
+        double ms[STAGE_COUNT];
+        for (int stage = 0; stage < STAGE_TOTAL; ++stage) {
+            ms[stage] = std::chrono::duration<double, std::milli>(s.times[stage + 1] - s.times[stage]).count();
+        }
+        ms[STAGE_TOTAL] = std::chrono::duration<double, std::milli>(s.times[STAGE_PRESENT + 1] - s.times[0]).count();
+
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            int bucket = std::min(kBuckets - 1, static_cast<int>(1000.0 * ms[stage] / kBucketUs));
+            ++mHistogram[stage][bucket];
+            mSumMs[stage] += ms[stage];
+            mWorstMs[stage] = std::max(mWorstMs[stage], ms[stage]);
+        }
+        ++mSamples;
+
+        if (mLog.is_open()) {
+            mLog << mSamples << ',' << s.tick;
+            for (double value : ms) mLog << ',' << value;
+            mLog << '\n';
+        }
+    }
+
+    Press mPending[kPending];
+    int mPendingFirst{0};
+    int mPendingCount{0};
+
+    Shot mShots[kInFlight];
+    int mNextShot{0};
+    int mDrawnCount{0};
+
+    Uint32 mSamples{0};
+    Uint32 mLost{0};
+    Uint32 mHistogram[STAGE_COUNT][kBuckets]{};
+    double mSumMs[STAGE_COUNT]{};
+    double mWorstMs[STAGE_COUNT]{};
+
+    std::ofstream mLog;
+};
+
+#endif
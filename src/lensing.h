@@ -0,0 +1,329 @@
+#ifndef BlackHole_lensing_h
+#define BlackHole_lensing_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "renderstats.h"
+#include "texture.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Time spent in each step of the last LensingEffect::apply, in seconds.
+struct LensingTimes {
+    double readback{0.0};
+    double process{0.0};
+    double upload{0.0};
+
+    double total() const { return readback + process + upload; }
+};
+
+// Gravitational lensing around an attractor, as a post-process on the
+// software rendered frame. Only the square of the lens around the
+// attractor is read back from the renderer, distorted on the CPU and
+// drawn over the frame again.
+//
+// What the lens does to a pixel only depends on where the pixel is
+// relative to the attractor, so the lens is a lookup table of source
+// offsets (and a mask for the event horizon) that is rebuilt only when
+// the radius changes. Applying it is a gather through the table: SSE2
+// computes the source indices 8 pixels at a time, AVX2 (if enabled) also
+// does the loads, and the rows are split between worker threads.
+class LensingEffect {
+public:
+    // Up to `threads` threads work on a frame, including the caller's.
+    LensingEffect(int screenWidth, int screenHeight, unsigned threads)
+    : mScreenWidth(screenWidth), mScreenHeight(screenHeight)
+    {
+        for (unsigned i = 1; i < std::max(1u, threads); ++i) {
+            mWorkers.emplace_back(&LensingEffect::workerLoop, this, i);
+        }
+    }
+
+    ~LensingEffect() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+        for (auto& worker : mWorkers) worker.join();
+    }
+
+    LensingEffect(const LensingEffect&) = delete;
+    LensingEffect& operator=(const LensingEffect&) = delete;
+
+    unsigned threads() const { return static_cast<unsigned>(mWorkers.size()) + 1; }
+
+    // The lens reaches `radius` pixels from the attractor. Nothing closer
+    // than `horizon` (as a share of the radius) escapes, and `strength`
+    // (also a share of the radius) is the Einstein radius, where the
+    // light bends the most.
+    void setLens(int radius, float horizon, float strength) {
+        if (radius == mRadius && horizon == mHorizon && strength == mStrength) return;
+
+        mRadius = radius;
+        mHorizon = horizon;
+        mStrength = strength;
+        buildTable();
+    }
+
+    // Without SIMD, for comparison in the benchmark.
+    void setScalar(bool scalar) { mScalar = scalar; }
+
+    // Lenses the frame in the renderer around screen position (x, y).
+    void apply(SDL_Renderer* renderer, int x, int y) {
+        using Clock = std::chrono::high_resolution_clock;
+
+        // The part of the lens on screen.
+        SDL_Rect region;
+        region.x = std::max(0, x - mRadius);
+        region.y = std::max(0, y - mRadius);
+        region.w = std::min(mScreenWidth, x + mRadius) - region.x;
+        region.h = std::min(mScreenHeight, y + mRadius) - region.y;
+        mTimes = LensingTimes();
+        if (region.w <= 0 || region.h <= 0) return;
+
+        if (!mTexture) {
+            mTexture = make_shared(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                                     2 * mRadius, 2 * mRadius));
+            if (!mTexture) {
+                throw std::runtime_error("Unable to create the lensing texture.");
+            }
+            mSource.resize(4 * mRadius * mRadius);
+            mResult.resize(4 * mRadius * mRadius);
+        }
+
+        auto start(Clock::now());
+        SDL_RenderReadPixels(renderer, &region, SDL_PIXELFORMAT_ARGB8888, mSource.data(), region.w * sizeof(Uint32));
+        auto readback(Clock::now());
+
+        process(region.w, region.h, region.x - (x - mRadius), region.y - (y - mRadius));
+        auto processed(Clock::now());
+
+        SDL_Rect area{0, 0, region.w, region.h};
+        SDL_UpdateTexture(mTexture.get(), &area, mResult.data(), region.w * sizeof(Uint32));
+        SDL_RenderCopy(renderer, mTexture.get(), &area, &region);
+        RenderStats::countDrawCall();
+        auto uploaded(Clock::now());
+
+        mTimes.readback = std::chrono::duration<double>(readback - start).count();
+        mTimes.process = std::chrono::duration<double>(processed - readback).count();
+        mTimes.upload = std::chrono::duration<double>(uploaded - processed).count();
+    }
+
+    const LensingTimes& times() const { return mTimes; }
+
+private:
+    // Deflection falls off to nothing at the edge of the lens, so the
+    // lensed square blends into the rest of the frame.
+    void buildTable() {
+        if (mRadius <= 0 || 2 * mRadius > 0x7FFF) {
+            throw std::runtime_error("Unsupported lensing radius.");
+        }
+
+        int size = 2 * mRadius;
+        mTableSize = size;
+        mOffsetX.assign(size * size, 0);
+        mOffsetY.assign(size * size, 0);
+        mMask.assign(size * size, 0xFFFFFFFFu);
+        mTexture.reset();
+
+        float horizon = mHorizon * mRadius;
+        float einstein = mStrength * mRadius;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                float px = x + 0.5f - mRadius;
+                float py = y + 0.5f - mRadius;
+                float r = std::sqrt(px * px + py * py);
+                int i = y * size + x;
+
+                if (r < horizon) {
+                    mMask[i] = 0;
+                    continue;
+                }
+                if (r >= mRadius) continue;
+
+                // Light passing the attractor bends towards it, so each
+                // pixel shows what is further in along its ray.
+                float falloff = 1.0f - (r * r) / (1.0f * mRadius * mRadius);
+                float deflection = einstein * einstein / r * falloff * falloff;
+                mOffsetX[i] = static_cast<std::int16_t>(std::lround(-px / r * deflection));
+                mOffsetY[i] = static_cast<std::int16_t>(std::lround(-py / r * deflection));
+            }
+        }
+    }
+
+    // Fills mResult (`width` x `height`) from mSource; (tableX, tableY) is
+    // the region's top left corner in the table.
+    void process(int width, int height, int tableX, int tableY) {
+        mJob.width = width;
+        mJob.height = height;
+        mJob.tableX = tableX;
+        mJob.tableY = tableY;
+
+        if (mWorkers.empty()) {
+            processPart(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mGeneration;
+            mPending = mWorkers.size();
+        }
+        mWake.notify_all();
+
+        processPart(0);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this] { return mPending == 0; });
+    }
+
+    // Each thread takes an equal share of the rows.
+    void processPart(unsigned part) {
+        unsigned parts = threads();
+        int begin = static_cast<int>(1ll * mJob.height * part / parts);
+        int end = static_cast<int>(1ll * mJob.height * (part + 1) / parts);
+        for (int y = begin; y < end; ++y) {
+            if (mScalar) processRowScalar(y);
+            else processRow(y);
+        }
+    }
+
+    void processRowScalar(int y) {
+        const int width = mJob.width;
+        const int table = (mJob.tableY + y) * mTableSize + mJob.tableX;
+        Uint32* out = &mResult[y * width];
+
+        for (int x = 0; x < width; ++x) {
+            int sx = std::max(0, std::min(width - 1, x + mOffsetX[table + x]));
+            int sy = std::max(0, std::min(mJob.height - 1, y + mOffsetY[table + x]));
+            Uint32 mask = mMask[table + x];
+            out[x] = (mSource[sy * width + sx] & mask) | (BLACK & ~mask);
+        }
+    }
+
+    void processRow(int y) {
+#if defined(__SSE2__)
+        const int width = mJob.width;
+        const int table = (mJob.tableY + y) * mTableSize + mJob.tableX;
+        const Uint32* source = mSource.data();
+        Uint32* out = &mResult[y * width];
+
+        // Source indices are sx + sy * width, from 16 bit coordinates
+        // (the lens is at most 0x7FFF wide) with one multiply-add.
+        const __m128i lanes = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m128i maxX = _mm_set1_epi16(static_cast<short>(width - 1));
+        const __m128i maxY = _mm_set1_epi16(static_cast<short>(mJob.height - 1));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i row = _mm_set1_epi16(static_cast<short>(y));
+        const __m128i pitch = _mm_set1_epi32((width << 16) | 1);    // (1, width) pairs
+        const __m128i black = _mm_set1_epi32(static_cast<int>(BLACK));
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m128i dx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&mOffsetX[table + x]));
+            __m128i dy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&mOffsetY[table + x]));
+            __m128i sx = _mm_add_epi16(_mm_add_epi16(_mm_set1_epi16(static_cast<short>(x)), lanes), dx);
+            __m128i sy = _mm_add_epi16(row, dy);
+            sx = _mm_min_epi16(_mm_max_epi16(sx, zero), maxX);
+            sy = _mm_min_epi16(_mm_max_epi16(sy, zero), maxY);
+
+            __m128i low = _mm_madd_epi16(_mm_unpacklo_epi16(sx, sy), pitch);
+            __m128i high = _mm_madd_epi16(_mm_unpackhi_epi16(sx, sy), pitch);
+
+#if defined(__AVX2__)
+            __m256i indices = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+            __m256i pixels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(source), indices, 4);
+            __m128i pixelsLow = _mm256_castsi256_si128(pixels);
+            __m128i pixelsHigh = _mm256_extracti128_si256(pixels, 1);
+#else
+            alignas(16) std::int32_t indices[8];
+            _mm_store_si128(reinterpret_cast<__m128i*>(indices), low);
+            _mm_store_si128(reinterpret_cast<__m128i*>(indices + 4), high);
+            __m128i pixelsLow = _mm_setr_epi32(source[indices[0]], source[indices[1]], source[indices[2]], source[indices[3]]);
+            __m128i pixelsHigh = _mm_setr_epi32(source[indices[4]], source[indices[5]], source[indices[6]], source[indices[7]]);
+#endif
+
+            __m128i maskLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&mMask[table + x]));
+            __m128i maskHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&mMask[table + x + 4]));
+            pixelsLow = _mm_or_si128(_mm_and_si128(pixelsLow, maskLow), _mm_andnot_si128(maskLow, black));
+            pixelsHigh = _mm_or_si128(_mm_and_si128(pixelsHigh, maskHigh), _mm_andnot_si128(maskHigh, black));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), pixelsLow);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 4), pixelsHigh);
+        }
+
+        for (; x < width; ++x) {
+            int sx = std::max(0, std::min(width - 1, x + mOffsetX[table + x]));
+            int sy = std::max(0, std::min(mJob.height - 1, y + mOffsetY[table + x]));
+            Uint32 mask = mMask[table + x];
+            out[x] = (source[sy * width + sx] & mask) | (BLACK & ~mask);
+        }
+#else
+        processRowScalar(y);
+#endif
+    }
+
+    void workerLoop(unsigned part) {
+        Uint64 seen = 0;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWake.wait(lock, [&] { return mStopping || mGeneration != seen; });
+            if (mStopping) return;
+            seen = mGeneration;
+
+            lock.unlock();
+            processPart(part);
+            lock.lock();
+
+            if (--mPending == 0) mDone.notify_one();
+        }
+    }
+
+    static constexpr Uint32 BLACK = 0xFF000000u;
+
+    int mScreenWidth, mScreenHeight;
+    int mRadius{0};
+    float mHorizon{0.0f};
+    float mStrength{0.0f};
+    bool mScalar{false};
+
+    // Per pixel of the lens: where to sample, relative to the pixel, and
+    // all ones outside the event horizon.
+    int mTableSize{0};
+    std::vector<std::int16_t> mOffsetX, mOffsetY;
+    std::vector<Uint32> mMask;
+
+    std::vector<Uint32> mSource;
+    std::vector<Uint32> mResult;
+    SharedSDLTexture mTexture;
+    LensingTimes mTimes;
+
+    // The region being processed, written before the workers are woken.
+    struct Job {
+        int width, height;
+        int tableX, tableY;
+    } mJob;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    Uint64 mGeneration{0};
+    std::size_t mPending{0};
+    bool mStopping{false};
+    std::vector<std::thread> mWorkers;
+};
+
+#endif
@@ -0,0 +1,403 @@
+#ifndef BlackHole_lockstep_h
+#define BlackHole_lockstep_h
+
+#include "net.h"
+#include "replay.h"
+#include <array>
+#include <memory>
+#include <ostream>
+
+// Settings for a two-player lockstep session.
+struct LockstepOptions {
+    // The host listens on `port`; the client connects to `host`:`port`.
+    bool isHost{true};
+    std::string host;
+    unsigned short port{0};
+
+    // Local input is applied this many ticks after it is sampled, which
+    // hides most of the network delay without any rollback.
+    Uint32 inputDelay{3};
+
+    // Simulation rate; the client adopts the host's.
+    Uint32 ticksPerSecond{60};
+
+    // Simulated network conditions for outgoing datagrams.
+    float lossRate{0.0f};
+    Uint32 jitterMs{0};
+};
+
+// Deterministic lockstep with rollback for two players.
+//
+// Each peer only sends its own per-tick InputFrame. Every datagram carries
+// all frames the peer has not acknowledged yet (redundancy), run-length
+// encoded against the previous frame (delta compression, since input rarely
+// changes from one tick to the next). The simulation may run ahead of the
+// remote input by up to kMaxPrediction ticks by predicting that the remote
+// player keeps doing what they did last; when a late frame contradicts a
+// prediction the game rolls back to that tick and re-simulates.
+class LockstepSession {
+public:
+    static const int kNumPlayers = 2;
+    static const Uint32 kMaxPrediction = 8;
+    static const Uint32 kMaxRedundancy = 64;
+    static const Uint32 kCheckInterval = 60;
+
+    LockstepSession(const LockstepOptions& options)
+    : mOptions(options),
+      mSocket(options.isHost ? options.port : 0),
+      mShim(mSocket, options.lossRate, options.jitterMs, options.isHost ? 1u : 2u)
+    {
+        if (!mOptions.isHost) {
+            mSocket.setPeer(mOptions.host, mOptions.port);
+        }
+        
+        // At least one tick of delay, so there is always a previous
+        // confirmed remote frame to predict from.
+        mOptions.inputDelay = std::max(1u, std::min(mOptions.inputDelay, 255u));
+    }
+
+    ~LockstepSession() {
+        // Let the peer know we are gone instead of leaving it stalled.
+        Uint8 bye = PT_BYE;
+        for (int i = 0; i < 3; i++) mSocket.send(&bye, 1);
+    }
+
+    // Blocks until both peers are connected and returns the session seed,
+    // which the host picks and the client receives (along with the input
+    // delay and tick rate).
+    Uint32 connect(Uint32 hostSeed, Uint32 timeoutMs) {
+        if (mOptions.isHost) mSeed = hostSeed;
+
+        Uint32 start = SDL_GetTicks();
+        Uint32 lastHello = 0;
+        while (!mConnected) {
+            if (SDL_GetTicks() - start > timeoutMs) {
+                throw std::runtime_error("Timed out waiting for the other player.");
+            }
+
+            if (!mOptions.isHost && (lastHello == 0 || SDL_GetTicks() - lastHello >= 100)) {
+                Uint8 hello[5] = {PT_HELLO};
+                ReplayFormat::putU32(hello + 1, kProtocolVersion);
+                sendDatagram(hello, sizeof(hello));
+                lastHello = SDL_GetTicks();
+            }
+
+            receive();
+            mShim.flush();
+            SDL_Delay(1);
+        }
+
+        // Ticks before the input delay has elapsed have no input on either side.
+        for (Uint32 tick = 0; tick < mOptions.inputDelay; ++tick) {
+            Slot& s(slot(tick));
+            s.remoteConfirmed = true;
+        }
+        mLocalNext = mOptions.inputDelay;
+        mRemoteNext = mOptions.inputDelay;
+        mLocalAcked = mOptions.inputDelay;
+
+        return mSeed;
+    }
+
+    int localPlayer() const { return mOptions.isHost ? 0 : 1; }
+    Uint32 inputDelay() const { return mOptions.inputDelay; }
+    Uint32 ticksPerSecond() const { return mOptions.ticksPerSecond; }
+    bool peerLeft() const { return mPeerLeft; }
+
+    // Schedules the input sampled on this tick for tick + inputDelay.
+    void addLocalInput(const InputFrame& input) {
+        Slot& s(slot(mLocalNext));
+        s.local = input;
+        s.firstSent = 0;
+        ++mLocalNext;
+    }
+
+    // Receives pending datagrams from the peer.
+    void poll() {
+        receive();
+    }
+    
+    // Sends our unacknowledged input (and acks for the peer's).
+    void flush() {
+        sendInputs();
+        mShim.flush();
+    }
+
+    // Whether `tick` can be simulated without predicting too far ahead of
+    // the remote input (or overrunning the unacknowledged input window).
+    bool canAdvance(Uint32 tick) const {
+        return tick < mRemoteNext + kMaxPrediction
+            && mLocalNext - mLocalAcked < kRingSize - kMaxRedundancy - kMaxPrediction;
+    }
+
+    // The inputs to simulate `tick` with. The remote input is predicted if
+    // it has not arrived yet, and the prediction is remembered so a later
+    // correction can trigger a rollback.
+    void inputsFor(Uint32 tick, InputFrame* inputs) {
+        Slot& s(slot(tick));
+        InputFrame remote = s.remoteConfirmed ? s.remote : slot(mRemoteNext - 1).remote;
+
+        s.used = remote;
+        s.simulated = true;
+
+        inputs[localPlayer()] = s.local;
+        inputs[1 - localPlayer()] = remote;
+    }
+
+    // The earliest tick that was simulated with a wrong prediction, if any.
+    bool takeRollback(Uint32& tick) {
+        if (!mMispredicted) return false;
+        tick = mMispredictedTick;
+        mMispredicted = false;
+        mRollbacks++;
+        return true;
+    }
+
+    void noteResimulated(Uint32 ticks) { mResimulatedTicks += ticks; }
+    void noteStall() { mStalledTicks++; }
+
+    // Periodic world hashes are exchanged once both inputs for that tick
+    // are final, so a desync is reported at the tick it first shows up.
+    void recordStateHash(Uint32 tick, Uint32 hash) {
+        if (tick % kCheckInterval != 0) return;
+
+        Check& c(mLocalChecks[(tick / kCheckInterval) % mLocalChecks.size()]);
+        c.tick = tick;
+        c.hash = hash;
+        c.valid = true;
+    }
+
+    bool desynced() const { return mDesynced; }
+    Uint32 desyncTick() const { return mDesyncTick; }
+
+    void report(std::ostream& out, Uint32 ticks, double secondsPerTick) const {
+        double perTick = ticks > 0 ? 1.0 / ticks : 0.0;
+        out << "Lockstep: " << ticks << " ticks"
+            << ", sent " << mBytesSent * perTick << " B/tick (" << mBytesSent * perTick * 8.0 / secondsPerTick / 1000.0 << " kbit/s)"
+            << ", received " << mBytesReceived * perTick << " B/tick"
+            << ", input delay " << mOptions.inputDelay << " ticks (" << mOptions.inputDelay * secondsPerTick * 1000.0 << " ms)"
+            << ", rtt " << (mRttSamples > 0 ? double(mRttTotalMs) / mRttSamples : 0.0) << " ms"
+            << ", rollbacks " << mRollbacks << " (" << mResimulatedTicks << " ticks resimulated"
+            << ", " << mResimulatedTicks * perTick << " per tick)"
+            << ", stalls " << mStalledTicks
+            << ", shim dropped " << mShim.dropped() << "/" << mShim.sent()
+            << std::endl;
+    }
+
+private:
+    static const Uint32 kProtocolVersion = 2;
+    static const Uint32 kRingSize = 256;
+    static const std::size_t kMaxDatagram = LossShim::kMaxDatagram;
+
+    enum PacketType : Uint8 {
+        PT_HELLO = 1,
+        PT_WELCOME,
+        PT_INPUT,
+        PT_BYE
+    };
+
+    struct Slot {
+        Uint32 tick{~0u};
+        InputFrame local;
+        InputFrame remote;
+        InputFrame used;
+        bool remoteConfirmed{false};
+        bool simulated{false};
+        Uint32 firstSent{0};
+    };
+
+    struct Check {
+        Uint32 tick{0};
+        Uint32 hash{0};
+        bool valid{false};
+    };
+
+    Slot& slot(Uint32 tick) {
+        Slot& s(mSlots[tick % kRingSize]);
+        if (s.tick != tick) {
+            s = Slot();
+            s.tick = tick;
+        }
+        return s;
+    }
+
+    bool settled(Uint32 tick) const {
+        return tick < mRemoteNext && !(mMispredicted && mMispredictedTick <= tick);
+    }
+
+    void sendDatagram(const Uint8* data, std::size_t size) {
+        mShim.send(data, size);
+        mBytesSent += size;
+    }
+
+    // INPUT layout: type (u8), ack (u32), first tick (u32), frame count (u8),
+    // check tick (u32), check hash (u32), then (bits, run length) pairs.
+    void sendInputs() {
+        if (!mConnected) return;
+
+        Uint8 packet[kMaxDatagram];
+        Uint32 first = mLocalAcked;
+        Uint32 count = mLocalNext - first;
+        if (count > kMaxRedundancy) count = kMaxRedundancy;
+
+        packet[0] = PT_INPUT;
+        ReplayFormat::putU32(packet + 1, mRemoteNext);
+        ReplayFormat::putU32(packet + 5, first);
+        packet[9] = static_cast<Uint8>(count);
+
+        Check latest;
+        for (auto& c : mLocalChecks) {
+            if (c.valid && settled(c.tick) && (!latest.valid || c.tick > latest.tick)) latest = c;
+        }
+        ReplayFormat::putU32(packet + 10, latest.valid ? latest.tick : ~0u);
+        ReplayFormat::putU32(packet + 14, latest.hash);
+
+        std::size_t size = 18;
+        Uint32 now = SDL_GetTicks();
+        for (Uint32 i = 0; i < count; ) {
+            Slot& s(slot(first + i));
+            Uint8 bits = s.local.bits();
+            Uint32 run = 1;
+            while (i + run < count && run < 255 && slot(first + i + run).local.bits() == bits) ++run;
+
+            packet[size++] = bits;
+            packet[size++] = static_cast<Uint8>(run);
+
+            for (Uint32 r = 0; r < run; ++r) {
+                Slot& sent(slot(first + i + r));
+                if (sent.firstSent == 0) sent.firstSent = now | 1;
+            }
+            i += run;
+        }
+
+        sendDatagram(packet, size);
+        mPacketsSent++;
+    }
+
+    void receive() {
+        Uint8 packet[kMaxDatagram];
+        int size;
+        while ((size = mSocket.receive(packet, sizeof(packet))) > 0) {
+            mBytesReceived += size;
+
+            switch (packet[0]) {
+                case PT_HELLO:
+                    if (mOptions.isHost && size >= 5 && ReplayFormat::getU32(packet + 1) == kProtocolVersion) {
+                        Uint8 welcome[11] = {PT_WELCOME};
+                        ReplayFormat::putU32(welcome + 1, kProtocolVersion);
+                        ReplayFormat::putU32(welcome + 5, mSeed);
+                        welcome[9] = static_cast<Uint8>(mOptions.inputDelay);
+                        welcome[10] = static_cast<Uint8>(mOptions.ticksPerSecond);
+                        sendDatagram(welcome, sizeof(welcome));
+                        mConnected = true;
+                    }
+                    break;
+
+                case PT_WELCOME:
+                    if (!mOptions.isHost && !mConnected && size >= 11 && ReplayFormat::getU32(packet + 1) == kProtocolVersion) {
+                        mSeed = ReplayFormat::getU32(packet + 5);
+                        mOptions.inputDelay = packet[9];
+                        mOptions.ticksPerSecond = packet[10];
+                        mConnected = true;
+                    }
+                    break;
+
+                case PT_INPUT:
+                    if (mConnected && size >= 18) {
+                        receiveInputs(packet, size);
+                    }
+                    break;
+
+                case PT_BYE:
+                    mPeerLeft = true;
+                    break;
+            }
+        }
+    }
+
+    void receiveInputs(const Uint8* packet, int size) {
+        Uint32 ack = ReplayFormat::getU32(packet + 1);
+        Uint32 tick = ReplayFormat::getU32(packet + 5);
+        Uint32 count = packet[9];
+        Uint32 checkTick = ReplayFormat::getU32(packet + 10);
+        Uint32 checkHash = ReplayFormat::getU32(packet + 14);
+
+        // Acknowledged local frames leave the redundancy window.
+        if (ack > mLocalAcked && ack <= mLocalNext) {
+            Uint32 now = SDL_GetTicks();
+            for (Uint32 t = mLocalAcked; t < ack; ++t) {
+                Slot& s(slot(t));
+                if (s.firstSent != 0) {
+                    mRttTotalMs += now - (s.firstSent & ~1u);
+                    mRttSamples++;
+                }
+            }
+            mLocalAcked = ack;
+        }
+
+        const Uint32 end = tick + count;
+        for (int offset = 18; offset + 1 < size && tick < end; offset += 2) {
+            InputFrame frame;
+            frame.setBits(packet[offset]);
+
+            for (Uint32 run = packet[offset + 1]; run > 0 && tick < end; --run, ++tick) {
+                if (tick < mRemoteNext || tick >= mRemoteNext + kMaxRedundancy) continue;
+
+                Slot& s(slot(tick));
+                if (s.remoteConfirmed) continue;
+
+                s.remote = frame;
+                s.remoteConfirmed = true;
+
+                if (s.simulated && s.used.bits() != frame.bits()
+                    && (!mMispredicted || tick < mMispredictedTick)) {
+                    mMispredicted = true;
+                    mMispredictedTick = tick;
+                }
+            }
+        }
+
+        while (slot(mRemoteNext).remoteConfirmed) ++mRemoteNext;
+
+        if (checkTick != ~0u) {
+            for (auto& c : mLocalChecks) {
+                if (c.valid && c.tick == checkTick && settled(c.tick) && c.hash != checkHash && !mDesynced) {
+                    mDesynced = true;
+                    mDesyncTick = checkTick;
+                }
+            }
+        }
+    }
+
+    LockstepOptions mOptions;
+    UdpSocket mSocket;
+    LossShim mShim;
+
+    bool mConnected{false};
+    bool mPeerLeft{false};
+    Uint32 mSeed{0};
+
+    std::array<Slot, kRingSize> mSlots;
+    Uint32 mLocalNext{0};   // next tick without local input
+    Uint32 mLocalAcked{0};  // the peer has our input for all ticks before this
+    Uint32 mRemoteNext{0};  // we have the peer's input for all ticks before this
+
+    bool mMispredicted{false};
+    Uint32 mMispredictedTick{0};
+
+    std::array<Check, 4> mLocalChecks;
+    bool mDesynced{false};
+    Uint32 mDesyncTick{0};
+
+    // Statistics
+    Uint64 mBytesSent{0};
+    Uint64 mBytesReceived{0};
+    Uint32 mPacketsSent{0};
+    Uint32 mRollbacks{0};
+    Uint32 mResimulatedTicks{0};
+    Uint32 mStalledTicks{0};
+    Uint64 mRttTotalMs{0};
+    Uint32 mRttSamples{0};
+};
+
+#endif
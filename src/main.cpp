@@ -1,14 +1,172 @@
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include "game.h"
 
+namespace {
+    void printUsage(const char* program) {
+        std::cerr << "Usage: " << program << " [--record <file>] [--replay <file>]\n"
+                  << "       [--load <checkpoint file>] [--checkpoint <file>] [--checkpoint-interval <ticks>]\n"
+                  << "       [--host <port> | --connect <host>:<port>] [--input-delay <ticks>]\n"
+                  << "       [--sim-loss <0..1>] [--sim-jitter <ms>]\n"
+                  << "       [--tick-rate <Hz>] [--fast-math] [--pixel-collisions]\n"
+                  << "       [--alloc-report] [--alloc-abort] [--alloc-test] [--timer-test]\n"
+                  << "       [--rotation-cache <angles>] [--sprite-benchmark]\n"
+                  << "       [--no-lensing] [--lensing-threads <n>] [--lensing-benchmark]\n"
+                  << "       [--capture <file>] [--no-trajectory]\n"
+                  << "       [--ai-pilots] [--ai-budget <pilots>] [--ai-threads <n>] [--ai-benchmark]\n"
+                  << "       [--spawn-benchmark]\n"
+                  << "       [--hud] [--latency-log <csv file>]\n";
+    }
+}
+
 int main(int argc, char *argv[]) {
+    GameOptions options;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        
+        if (arg == "--record" && i + 1 < argc) {
+            options.recordFile = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            options.replayFile = argv[++i];
+        }
+        else if (arg == "--load" && i + 1 < argc) {
+            options.loadFile = argv[++i];
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpointFile = argv[++i];
+        }
+        else if (arg == "--capture" && i + 1 < argc) {
+            options.captureFile = argv[++i];
+        }
+        else if (arg == "--latency-log" && i + 1 < argc) {
+            options.latencyLog = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            options.checkpointInterval = std::stoul(argv[++i]);
+        }
+        else if (arg == "--host" && i + 1 < argc) {
+            options.netPlay = true;
+            options.net.isHost = true;
+            options.net.port = static_cast<unsigned short>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--connect" && i + 1 < argc) {
+            std::string address(argv[++i]);
+            std::size_t colon = address.rfind(':');
+            if (colon == std::string::npos) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            options.netPlay = true;
+            options.net.isHost = false;
+            options.net.host = address.substr(0, colon);
+            options.net.port = static_cast<unsigned short>(std::stoul(address.substr(colon + 1)));
+        }
+        else if (arg == "--input-delay" && i + 1 < argc) {
+            options.net.inputDelay = std::stoul(argv[++i]);
+        }
+        else if (arg == "--sim-loss" && i + 1 < argc) {
+            options.net.lossRate = std::stof(argv[++i]);
+        }
+        else if (arg == "--sim-jitter" && i + 1 < argc) {
+            options.net.jitterMs = std::stoul(argv[++i]);
+        }
+        else if (arg == "--tick-rate" && i + 1 < argc) {
+            options.ticksPerSecond = std::stoul(argv[++i]);
+        }
+        else if (arg == "--fast-math") {
+            options.fastMath = true;
+        }
+        else if (arg == "--pixel-collisions") {
+            options.pixelCollisions = true;
+        }
+        else if (arg == "--alloc-report") {
+            options.allocReport = true;
+            if (options.allocHotPolicy == AllocTracker::HotPolicy::Ignore) {
+                options.allocHotPolicy = AllocTracker::HotPolicy::Report;
+            }
+        }
+        else if (arg == "--alloc-abort") {
+            options.allocHotPolicy = AllocTracker::HotPolicy::Abort;
+        }
+        else if (arg == "--alloc-test") {
+            options.allocTest = true;
+            if (options.allocHotPolicy == AllocTracker::HotPolicy::Ignore) {
+                options.allocHotPolicy = AllocTracker::HotPolicy::Report;
+            }
+        }
+        else if (arg == "--timer-test") {
+            options.timerTest = true;
+        }
+        else if (arg == "--rotation-cache" && i + 1 < argc) {
+            options.rotationSteps = std::stoi(argv[++i]);
+        }
+        else if (arg == "--sprite-benchmark") {
+            options.spriteBenchmark = true;
+        }
+        else if (arg == "--no-lensing") {
+            options.lensing = false;
+        }
+        else if (arg == "--lensing-threads" && i + 1 < argc) {
+            options.lensingThreads = std::stoul(argv[++i]);
+        }
+        else if (arg == "--lensing-benchmark") {
+            options.lensingBenchmark = true;
+        }
+        else if (arg == "--no-trajectory") {
+            options.trajectory = false;
+        }
+        else if (arg == "--ai-pilots") {
+            options.aiPilots = true;
+        }
+        else if (arg == "--ai-budget" && i + 1 < argc) {
+            options.aiThinkBudget = std::stoul(argv[++i]);
+        }
+        else if (arg == "--ai-threads" && i + 1 < argc) {
+            options.aiThreads = std::stoul(argv[++i]);
+        }
+        else if (arg == "--ai-benchmark") {
+            options.aiBenchmark = true;
+        }
+        else if (arg == "--spawn-benchmark") {
+            options.spawnBenchmark = true;
+        }
+        else if (arg == "--hud") {
+            options.hud = true;
+        }
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
     try {
-        Game game;
+        Game game(options);
+        if (options.allocTest) {
+            return game.runAllocationTest();
+        }
+        if (options.timerTest) {
+            return game.runTimerTest();
+        }
+        if (options.spriteBenchmark) {
+            return game.runSpriteBenchmark();
+        }
+        if (options.lensingBenchmark) {
+            return game.runLensingBenchmark();
+        }
+        if (options.aiBenchmark) {
+            return game.runAIBenchmark();
+        }
+        if (options.spawnBenchmark) {
+            return game.runSpawnBenchmark();
+        }
         game.run();
     }
     catch(const std::exception& e) {
-        std::cerr << e.what();
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
     
     return 0;
@@ -0,0 +1,171 @@
+#ifndef BlackHole_net_h
+#define BlackHole_net_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A non-blocking UDP socket talking to a single peer.
+class UdpSocket {
+public:
+    // Binds to the given local port (0 picks any free port).
+    UdpSocket(unsigned short port)
+    {
+        mSocket = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (mSocket < 0) {
+            throw std::runtime_error("Unable to create UDP socket.");
+        }
+
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(port);
+        if (::bind(mSocket, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+            ::close(mSocket);
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to bind UDP port " << port;
+            throw std::runtime_error(oss.str());
+        }
+
+        ::fcntl(mSocket, F_SETFL, ::fcntl(mSocket, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    ~UdpSocket() {
+        ::close(mSocket);
+    }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    void setPeer(const std::string& host, unsigned short port) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo* result = nullptr;
+        if (::getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || result == nullptr) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to resolve peer address (" << host << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        mPeer = *reinterpret_cast<sockaddr_in*>(result->ai_addr);
+        mPeer.sin_port = htons(port);
+        mHasPeer = true;
+        ::freeaddrinfo(result);
+    }
+
+    bool hasPeer() const { return mHasPeer; }
+
+    void send(const Uint8* data, std::size_t size) {
+        if (!mHasPeer) return;
+        ::sendto(mSocket, data, size, 0, reinterpret_cast<const sockaddr*>(&mPeer), sizeof(mPeer));
+    }
+
+    // Returns the size of the next datagram from the peer, or -1 if there
+    // is none. Until a peer is known, the first sender becomes the peer.
+    int receive(Uint8* data, std::size_t capacity) {
+        while (true) {
+            sockaddr_in from{};
+            socklen_t fromSize = sizeof(from);
+            ssize_t size = ::recvfrom(mSocket, data, capacity, 0, reinterpret_cast<sockaddr*>(&from), &fromSize);
+            if (size < 0) return -1;
+
+            if (!mHasPeer) {
+                mPeer = from;
+                mHasPeer = true;
+            }
+
+            if (from.sin_addr.s_addr == mPeer.sin_addr.s_addr && from.sin_port == mPeer.sin_port) {
+                return static_cast<int>(size);
+            }
+            // Datagrams from anyone else are ignored.
+        }
+    }
+
+private:
+    int mSocket;
+    sockaddr_in mPeer{};
+    bool mHasPeer{false};
+};
+
+// Sits between the game and the socket to simulate a bad network on a
+// machine where both peers run on localhost: outgoing datagrams are
+// dropped with probability `lossRate` and delayed by up to `jitterMs`.
+class LossShim {
+public:
+    static const std::size_t kMaxDatagram = 512;
+
+    LossShim(UdpSocket& socket, float lossRate, Uint32 jitterMs, Uint32 seed)
+    : mSocket(socket), mLossRate(lossRate), mJitterMs(jitterMs), mRandom(seed)
+    {
+    }
+
+    void send(const Uint8* data, std::size_t size) {
+        mSent++;
+        if (mLossRate > 0.0f && mChance(mRandom) < mLossRate) {
+            mDropped++;
+            return;
+        }
+
+        if (mJitterMs == 0 || size > kMaxDatagram) {
+            mSocket.send(data, size);
+            return;
+        }
+
+        Delayed delayed;
+        delayed.due = SDL_GetTicks() + mRandom() % (mJitterMs + 1);
+        delayed.size = size;
+        std::copy(data, data + size, delayed.data.begin());
+        mQueue.push_back(delayed);
+    }
+
+    // Sends the delayed datagrams that are due. Datagrams are reordered
+    // when a later one draws a shorter delay, as on a real network.
+    void flush() {
+        Uint32 now = SDL_GetTicks();
+        for (auto it = mQueue.begin(); it != mQueue.end(); ) {
+            if (static_cast<Sint32>(now - it->due) >= 0) {
+                mSocket.send(it->data.data(), it->size);
+                it = mQueue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    Uint32 sent() const { return mSent; }
+    Uint32 dropped() const { return mDropped; }
+
+private:
+    struct Delayed {
+        Uint32 due;
+        std::size_t size;
+        std::array<Uint8, kMaxDatagram> data;
+    };
+
+    UdpSocket& mSocket;
+    float mLossRate;
+    Uint32 mJitterMs;
+    std::mt19937 mRandom;
+    std::uniform_real_distribution<float> mChance{0.0f, 1.0f};
+    std::deque<Delayed> mQueue;
+    Uint32 mSent{0};
+    Uint32 mDropped{0};
+};
+
+#endif
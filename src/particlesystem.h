@@ -0,0 +1,242 @@
+#ifndef BlackHole_particlesystem_h
+#define BlackHole_particlesystem_h
+
+#include <SDL2/SDL.h>
+#include "camera.h"
+#include "renderstats.h"
+#include "spriteanimation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Short-lived visual effects (explosions, torpedo exhaust, debris) that live
+// outside the entity system. Particles are kept in a fixed-capacity
+// structure-of-arrays pool: spawning writes one slot, dying swaps the last
+// particle into the hole, and nothing is allocated after construction.
+// Particles are purely visual and never feed back into the simulation.
+class ParticleSystem {
+public:
+    // How one kind of particle looks: an animation played once over the
+    // particle's lifetime, drawn at a fixed on-screen size.
+    struct Style {
+        std::shared_ptr<SpriteAnimation> animation;
+        float width, height;
+        float lifetime;
+    };
+
+    using StyleID = std::size_t;
+
+    ParticleSystem(std::size_t capacity)
+    : mCapacity(capacity)
+    {
+        // Round up so the SIMD loop never needs a scalar tail.
+        std::size_t padded = (capacity + 3) & ~std::size_t(3);
+        for (auto* v : {&mX, &mY, &mVX, &mVY, &mAge, &mLifetime, &mFrameScale, &mLastFrame}) {
+            v->resize(padded, 0.0f);
+        }
+        mFrame.resize(padded, 0);
+        mStyle.resize(padded, 0);
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        mVertices.reserve(capacity * 4);
+        mIndices.reserve(capacity * 6);
+#endif
+    }
+
+    StyleID addStyle(const Style& style) {
+        mStyles.push_back(style);
+        return mStyles.size() - 1;
+    }
+
+    std::size_t size() const { return mCount; }
+    std::size_t capacity() const { return mCapacity; }
+    std::size_t dropped() const { return mDropped; }
+
+    // Spawns a single particle; when the pool is full the particle is
+    // dropped (and counted) rather than growing the pool.
+    void emit(StyleID styleID, float x, float y, float vx, float vy, float lifetimeScale = 1.0f) {
+        if (mCount == mCapacity) {
+            mDropped++;
+            return;
+        }
+
+        const Style& style(mStyles[styleID]);
+        float lifetime = style.lifetime * lifetimeScale;
+        int numFrames = style.animation->numFrames();
+
+        std::size_t i = mCount++;
+        mX[i] = x;
+        mY[i] = y;
+        mVX[i] = vx;
+        mVY[i] = vy;
+        mAge[i] = 0.0f;
+        mLifetime[i] = lifetime;
+        mFrameScale[i] = numFrames / lifetime;
+        mLastFrame[i] = static_cast<float>(numFrames - 1);
+        mFrame[i] = 0;
+        mStyle[i] = static_cast<std::uint16_t>(styleID);
+    }
+
+    // Spawns `count` particles flying outwards from (x, y) at up to `speed`.
+    void burst(StyleID styleID, float x, float y, int count, float speed) {
+        std::uniform_real_distribution<float> angle(0.0f, 2.0f * static_cast<float>(M_PI));
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        for (int n = 0; n < count; ++n) {
+            float a = angle(mRandom);
+            float s = speed * unit(mRandom);
+            emit(styleID, x, y, std::cos(a) * s, std::sin(a) * s, 0.5f + unit(mRandom));
+        }
+    }
+
+    void update(float ft) {
+        integrate(ft);
+
+        // Swap-remove the particles that reached the end of their life.
+        std::size_t i = 0;
+        while (i < mCount) {
+            if (mAge[i] >= mLifetime[i]) {
+                moveParticle(--mCount, i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    // Draws the particles in view of the camera with one geometry
+    // submission per sprite sheet.
+    void draw(const Camera& camera) {
+        if (mCount == 0) return;
+
+        for (std::size_t s = 0; s < mStyles.size(); ++s) {
+            const SpriteSheet& sheet(mStyles[s].animation->spriteSheet());
+
+            // Styles sharing a sheet were batched with the first of them.
+            bool seen = false;
+            for (std::size_t p = 0; p < s; ++p) {
+                seen = seen || &mStyles[p].animation->spriteSheet() == &sheet;
+            }
+            if (!seen) drawSheet(sheet, camera);
+        }
+    }
+
+private:
+    void integrate(float ft) {
+#if defined(__SSE2__)
+        const __m128 dt = _mm_set1_ps(ft);
+        for (std::size_t i = 0; i < mCount; i += 4) {
+            __m128 x = _mm_add_ps(_mm_loadu_ps(&mX[i]), _mm_mul_ps(_mm_loadu_ps(&mVX[i]), dt));
+            __m128 y = _mm_add_ps(_mm_loadu_ps(&mY[i]), _mm_mul_ps(_mm_loadu_ps(&mVY[i]), dt));
+            __m128 age = _mm_add_ps(_mm_loadu_ps(&mAge[i]), dt);
+            __m128 frame = _mm_min_ps(_mm_mul_ps(age, _mm_loadu_ps(&mFrameScale[i])), _mm_loadu_ps(&mLastFrame[i]));
+
+            _mm_storeu_ps(&mX[i], x);
+            _mm_storeu_ps(&mY[i], y);
+            _mm_storeu_ps(&mAge[i], age);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&mFrame[i]), _mm_cvttps_epi32(frame));
+        }
+#else
+        for (std::size_t i = 0; i < mCount; ++i) {
+            mX[i] += mVX[i] * ft;
+            mY[i] += mVY[i] * ft;
+            mAge[i] += ft;
+            mFrame[i] = static_cast<std::int32_t>(std::min(mAge[i] * mFrameScale[i], mLastFrame[i]));
+        }
+#endif
+    }
+
+    void moveParticle(std::size_t from, std::size_t to) {
+        mX[to] = mX[from];
+        mY[to] = mY[from];
+        mVX[to] = mVX[from];
+        mVY[to] = mVY[from];
+        mAge[to] = mAge[from];
+        mLifetime[to] = mLifetime[from];
+        mFrameScale[to] = mFrameScale[from];
+        mLastFrame[to] = mLastFrame[from];
+        mFrame[to] = mFrame[from];
+        mStyle[to] = mStyle[from];
+    }
+
+    void drawSheet(const SpriteSheet& sheet, const Camera& camera) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        mVertices.clear();
+        mIndices.clear();
+
+        const SDL_Color white{255, 255, 255, 255};
+        const float invW = 1.0f / sheet.width();
+        const float invH = 1.0f / sheet.height();
+
+        for (std::size_t i = 0; i < mCount; ++i) {
+            const Style& style(mStyles[mStyle[i]]);
+            if (&style.animation->spriteSheet() != &sheet) continue;
+
+            float left = mX[i] - style.width * 0.5f, right = left + style.width;
+            float top = mY[i] - style.height * 0.5f, bottom = top + style.height;
+            if (!camera.isVisible(left, top, right, bottom)) continue;
+
+            const SDL_Rect& src(style.animation->frameRect(mFrame[i]));
+            left -= camera.screenX();
+            right -= camera.screenX();
+            top -= camera.screenY();
+            bottom -= camera.screenY();
+            float u0 = src.x * invW, u1 = (src.x + src.w) * invW;
+            float v0 = src.y * invH, v1 = (src.y + src.h) * invH;
+
+            int base = static_cast<int>(mVertices.size());
+            mVertices.push_back({{left, top}, white, {u0, v0}});
+            mVertices.push_back({{right, top}, white, {u1, v0}});
+            mVertices.push_back({{right, bottom}, white, {u1, v1}});
+            mVertices.push_back({{left, bottom}, white, {u0, v1}});
+            for (int corner : {0, 1, 2, 0, 2, 3}) mIndices.push_back(base + corner);
+        }
+
+        if (!mVertices.empty()) {
+            SDL_RenderGeometry(sheet.getRenderer(), sheet.getSDLTexture(),
+                               mVertices.data(), static_cast<int>(mVertices.size()),
+                               mIndices.data(), static_cast<int>(mIndices.size()));
+            RenderStats::countDrawCall();
+        }
+#else
+        // Older SDL has no geometry API, so fall back to one copy per particle.
+        for (std::size_t i = 0; i < mCount; ++i) {
+            const Style& style(mStyles[mStyle[i]]);
+            if (&style.animation->spriteSheet() != &sheet) continue;
+
+            SDL_Rect dest{static_cast<int>(mX[i] - style.width * 0.5f), static_cast<int>(mY[i] - style.height * 0.5f),
+                          static_cast<int>(style.width), static_cast<int>(style.height)};
+            if (!camera.isVisible(dest.x, dest.y, dest.x + dest.w, dest.y + dest.h)) continue;
+            sheet.draw(style.animation->frameRect(mFrame[i]), camera.toScreen(dest));
+        }
+#endif
+    }
+
+    std::size_t mCapacity;
+    std::size_t mCount{0};
+    std::size_t mDropped{0};
+
+    std::vector<float> mX, mY, mVX, mVY;
+    std::vector<float> mAge, mLifetime, mFrameScale, mLastFrame;
+    std::vector<std::int32_t> mFrame;
+    std::vector<std::uint16_t> mStyle;
+
+    std::vector<Style> mStyles;
+
+    // Visual only, so it has its own generator and never touches the
+    // simulation's seeded randomness.
+    std::minstd_rand mRandom;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> mVertices;
+    std::vector<int> mIndices;
+#endif
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <SDL2/SDL_opengl.h>
 
 #include "window.h"
+#include "bitmapfont.h"
+#include "renderstats.h"
 #include "texture.h"
 #include "spritesheet.h"
 #include "spriteanimation.h"
@@ -58,8 +60,17 @@ public:
         return std::make_shared<SpriteAnimation>(spriteSheet, numWidth, numHeight);
     }
     
+    std::shared_ptr<BitmapFont> createFont() {
+        return std::make_shared<BitmapFont>(this->getRenderer());
+    }
+    
     void draw (Texture& texture) const {
         SDL_RenderCopy (mRenderer, texture.getSDLTexture(), NULL, NULL);
+        RenderStats::countDrawCall();
+    }
+    
+    void draw (const TextBatch& text) const {
+        text.draw();
     }
     
 protected:
@@ -0,0 +1,27 @@
+#ifndef BlackHole_renderstats_h
+#define BlackHole_renderstats_h
+
+#include <SDL2/SDL.h>
+
+// Counts the draw calls submitted to the SDL renderer, so the HUD can show
+// how many a frame takes. Everything that draws calls countDrawCall() next
+// to its SDL_Render* call; the game loop takes the count once per frame.
+namespace RenderStats {
+    inline Uint32& drawCalls() {
+        static Uint32 count = 0;
+        return count;
+    }
+
+    inline void countDrawCall(Uint32 calls = 1) {
+        drawCalls() += calls;
+    }
+
+    // The draw calls since the previous takeDrawCalls().
+    inline Uint32 takeDrawCalls() {
+        Uint32 count = drawCalls();
+        drawCalls() = 0;
+        return count;
+    }
+}
+
+#endif
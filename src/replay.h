@@ -0,0 +1,181 @@
+#ifndef BlackHole_replay_h
+#define BlackHole_replay_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The player input for one simulation tick, packed into a single byte:
+// bit 0 = rotate left, bit 1 = rotate right, bits 2-4 = fire presses.
+class InputFrame {
+public:
+    bool left() const { return (mBits & IF_LEFT) != 0; }
+    bool right() const { return (mBits & IF_RIGHT) != 0; }
+    int fireCount() const { return (mBits & IF_FIRE_MASK) >> IF_FIRE_SHIFT; }
+
+    void setLeft(bool on) { setBit(IF_LEFT, on); }
+    void setRight(bool on) { setBit(IF_RIGHT, on); }
+
+    void addFire() {
+        int count = fireCount();
+        if (count < IF_FIRE_MAX) {
+            mBits = (mBits & ~IF_FIRE_MASK) | ((count + 1) << IF_FIRE_SHIFT);
+        }
+    }
+
+    void clear() { mBits = 0; }
+
+    Uint8 bits() const { return mBits; }
+    void setBits(Uint8 bits) { mBits = bits; }
+
+private:
+    enum : Uint8 {
+        IF_LEFT = 1 << 0,
+        IF_RIGHT = 1 << 1,
+        IF_FIRE_SHIFT = 2,
+        IF_FIRE_MASK = 7 << 2,
+        IF_FIRE_MAX = 7
+    };
+
+    void setBit(Uint8 bit, bool on) {
+        if (on) mBits |= bit;
+        else mBits &= ~bit;
+    }
+
+    Uint8 mBits{0};
+};
+
+// FNV-1a, used to fingerprint the world state after every tick.
+class StateHash {
+public:
+    void add(const void* data, std::size_t size) {
+        const Uint8* bytes = static_cast<const Uint8*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            mHash ^= bytes[i];
+            mHash *= 16777619u;
+        }
+    }
+
+    void add(float value) { add(&value, sizeof(value)); }
+    void add(Uint32 value) { add(&value, sizeof(value)); }
+
+    Uint32 value() const { return mHash; }
+
+private:
+    Uint32 mHash{2166136261u};
+};
+
+// Replay file layout (little endian):
+//   header: "BHRP", version (u32), seed (u32), ticks per second (u32)
+//   one record per tick: input bits (u8), world state hash (u32)
+namespace ReplayFormat {
+    const char kMagic[4] = {'B', 'H', 'R', 'P'};
+    const Uint32 kVersion = 1;
+    const std::size_t kHeaderSize = 16;
+    const std::size_t kRecordSize = 5;
+
+    inline void putU32(Uint8* out, Uint32 value) {
+        out[0] = value & 0xFF;
+        out[1] = (value >> 8) & 0xFF;
+        out[2] = (value >> 16) & 0xFF;
+        out[3] = (value >> 24) & 0xFF;
+    }
+
+    inline Uint32 getU32(const Uint8* in) {
+        return Uint32(in[0]) | (Uint32(in[1]) << 8) | (Uint32(in[2]) << 16) | (Uint32(in[3]) << 24);
+    }
+}
+
+// Writes the seed and the per-tick input/hash log of a live session.
+class ReplayRecorder {
+public:
+    ReplayRecorder(const std::string& filename, Uint32 seed, Uint32 ticksPerSecond)
+    : mFile(filename.c_str(), std::ios::binary | std::ios::trunc)
+    {
+        if (!mFile) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to open replay file for writing (" << filename << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        Uint8 header[ReplayFormat::kHeaderSize];
+        std::copy(ReplayFormat::kMagic, ReplayFormat::kMagic + 4, header);
+        ReplayFormat::putU32(header + 4, ReplayFormat::kVersion);
+        ReplayFormat::putU32(header + 8, seed);
+        ReplayFormat::putU32(header + 12, ticksPerSecond);
+        mFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    void record(const InputFrame& input, Uint32 stateHash) {
+        Uint8 rec[ReplayFormat::kRecordSize];
+        rec[0] = input.bits();
+        ReplayFormat::putU32(rec + 1, stateHash);
+        mFile.write(reinterpret_cast<const char*>(rec), sizeof(rec));
+        ++mNumTicks;
+    }
+
+    Uint32 numTicks() const { return mNumTicks; }
+
+private:
+    std::ofstream mFile;
+    Uint32 mNumTicks{0};
+};
+
+// Loads a recorded session so it can be fed back through the fixed-step loop.
+class ReplayPlayer {
+public:
+    ReplayPlayer(const std::string& filename)
+    {
+        std::ifstream file(filename.c_str(), std::ios::binary);
+        if (!file) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to open replay file (" << filename << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        std::vector<Uint8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() < ReplayFormat::kHeaderSize
+            || !std::equal(ReplayFormat::kMagic, ReplayFormat::kMagic + 4, data.begin())
+            || ReplayFormat::getU32(&data[4]) != ReplayFormat::kVersion) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Not a valid replay file (" << filename << ")";
+            throw std::runtime_error(oss.str());
+        }
+
+        mSeed = ReplayFormat::getU32(&data[8]);
+        mTicksPerSecond = ReplayFormat::getU32(&data[12]);
+
+        std::size_t numTicks = (data.size() - ReplayFormat::kHeaderSize) / ReplayFormat::kRecordSize;
+        mInputs.resize(numTicks);
+        mHashes.resize(numTicks);
+        for (std::size_t i = 0; i < numTicks; ++i) {
+            const Uint8* rec = &data[ReplayFormat::kHeaderSize + i * ReplayFormat::kRecordSize];
+            mInputs[i].setBits(rec[0]);
+            mHashes[i] = ReplayFormat::getU32(rec + 1);
+        }
+    }
+
+    Uint32 seed() const { return mSeed; }
+    Uint32 ticksPerSecond() const { return mTicksPerSecond; }
+    Uint32 numTicks() const { return static_cast<Uint32>(mInputs.size()); }
+
+    bool hasTick(Uint32 tick) const { return tick < mInputs.size(); }
+    const InputFrame& input(Uint32 tick) const { return mInputs[tick]; }
+    Uint32 stateHash(Uint32 tick) const { return mHashes[tick]; }
+
+private:
+    Uint32 mSeed{0};
+    Uint32 mTicksPerSecond{0};
+    std::vector<InputFrame> mInputs;
+    std::vector<Uint32> mHashes;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef BlackHole_rotationcache_h
+#define BlackHole_rotationcache_h
+
+#include <SDL2/SDL.h>
+#include <cmath>
+#include <stdexcept>
+#include "renderstats.h"
+#include "spritesheet.h"
+
+// A subimage pre-scaled to the size it is drawn at and pre-rendered at
+// `steps` evenly spaced angles, all in one atlas texture. The software
+// renderer rotates and scales every pixel of the source rect on each
+// SDL_RenderCopyEx; drawing from the cache is a plain copy of the nearest
+// angle instead, at the cost of up to half a step of angle error.
+class RotationCache {
+public:
+    RotationCache(const SpriteSheet& sheet, const SDL_Rect& src, int width, int height, int steps)
+    : mRenderer(sheet.getRenderer()), mWidth(width), mHeight(height), mSteps(steps)
+    {
+        if (steps < 1) {
+            throw std::runtime_error("A rotation cache needs at least one angle.");
+        }
+
+        // Every angle fits in a cell as wide as the sprite's diagonal. The
+        // padding is the same on both sides, so the cell and the sprite
+        // share a center in whole pixels.
+        float diagonal = std::sqrt(1.0f * width * width + 1.0f * height * height);
+        mPadX = static_cast<int>(std::ceil((diagonal - width) / 2.0f));
+        mPadY = static_cast<int>(std::ceil((diagonal - height) / 2.0f));
+        mCellWidth = width + 2 * mPadX;
+        mCellHeight = height + 2 * mPadY;
+        mColumns = static_cast<int>(std::ceil(std::sqrt(1.0 * steps)));
+        int rows = (steps + mColumns - 1) / mColumns;
+
+        mAtlas = make_shared(SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                               mColumns * mCellWidth, rows * mCellHeight));
+        if (!mAtlas) {
+            throw std::runtime_error("Unable to create a rotation cache texture.");
+        }
+        SDL_SetTextureBlendMode(mAtlas.get(), SDL_BLENDMODE_BLEND);
+
+        SDL_Texture* previousTarget = SDL_GetRenderTarget(mRenderer);
+        Uint8 r, g, b, a;
+        SDL_GetRenderDrawColor(mRenderer, &r, &g, &b, &a);
+
+        if (SDL_SetRenderTarget(mRenderer, mAtlas.get()) != 0) {
+            throw std::runtime_error("The renderer cannot pre-render rotated sprites.");
+        }
+        SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 0);
+        SDL_RenderClear(mRenderer);
+
+        for (int i = 0; i < steps; ++i) {
+            SDL_Rect cell(cellRect(i));
+            SDL_Rect dest{cell.x + mPadX, cell.y + mPadY, width, height};
+            sheet.draw(src, dest, angleOf(i), NULL);
+        }
+
+        SDL_SetRenderTarget(mRenderer, previousTarget);
+        SDL_SetRenderDrawColor(mRenderer, r, g, b, a);
+    }
+
+    // Whether draws of this size can use the cache.
+    bool fits(int width, int height) const {
+        return width == mWidth && height == mHeight;
+    }
+
+    int steps() const { return mSteps; }
+
+    // The angle pre-rendered at step `i`, in degrees.
+    double angleOf(int i) const { return 360.0 * i / mSteps; }
+
+    int nearestStep(double angle) const {
+        long step = std::lround(angle * mSteps / 360.0) % mSteps;
+        return static_cast<int>(step < 0 ? step + mSteps : step);
+    }
+
+    // Draws the sprite rotated by the nearest cached angle into the
+    // `width` x `height` box at (x, y).
+    void draw(int x, int y, double angle) const {
+        SDL_Rect src(cellRect(nearestStep(angle)));
+        SDL_Rect dest{x - mPadX, y - mPadY, mCellWidth, mCellHeight};
+        SDL_RenderCopy(mRenderer, mAtlas.get(), &src, &dest);
+        RenderStats::countDrawCall();
+    }
+
+private:
+    SDL_Rect cellRect(int step) const {
+        return SDL_Rect{(step % mColumns) * mCellWidth, (step / mColumns) * mCellHeight, mCellWidth, mCellHeight};
+    }
+
+    SDL_Renderer* mRenderer;
+    SharedSDLTexture mAtlas;
+    int mWidth, mHeight;
+    int mSteps;
+    int mPadX, mPadY;
+    int mCellWidth, mCellHeight;
+    int mColumns;
+};
+
+#endif
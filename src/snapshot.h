@@ -0,0 +1,299 @@
+#ifndef BlackHole_snapshot_h
+#define BlackHole_snapshot_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Appends plain values to a byte buffer. Values are stored in host byte
+// order; snapshots are meant for the machine (and build) that wrote them.
+// The buffer is grown geometrically and trimmed when the writer goes out of
+// scope, so reusing one buffer across snapshots does not reallocate.
+class SnapshotWriter {
+public:
+    SnapshotWriter(std::vector<Uint8>& buffer) : mBuffer(buffer) {
+        mBuffer.resize(mBuffer.capacity());
+    }
+
+    ~SnapshotWriter() {
+        mBuffer.resize(mSize);
+    }
+
+    template<typename T> void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written to a snapshot");
+        if (mSize + sizeof(T) > mBuffer.size()) {
+            mBuffer.resize(std::max<std::size_t>(2 * mBuffer.size(), 4096));
+        }
+        std::memcpy(&mBuffer[mSize], &value, sizeof(T));
+        mSize += sizeof(T);
+    }
+
+    void writeBytes(const void* data, std::size_t size) {
+        if (mSize + size > mBuffer.size()) {
+            mBuffer.resize(std::max<std::size_t>(2 * mBuffer.size(), std::max<std::size_t>(mSize + size, 4096)));
+        }
+        if (size) std::memcpy(&mBuffer[mSize], data, size);
+        mSize += size;
+    }
+
+    // Reserves room for a value that is only known later (e.g. a size).
+    template<typename T> std::size_t placeholder() {
+        std::size_t offset = mSize;
+        write(T());
+        return offset;
+    }
+
+    template<typename T> void patch(std::size_t offset, const T& value) {
+        std::memcpy(&mBuffer[offset], &value, sizeof(T));
+    }
+
+    std::size_t size() const { return mSize; }
+
+private:
+    std::vector<Uint8>& mBuffer;
+    std::size_t mSize{0};
+};
+
+// Reads back what SnapshotWriter wrote, throwing on truncated data.
+class SnapshotReader {
+public:
+    SnapshotReader(const Uint8* data, std::size_t size) : mData(data), mSize(size) {}
+    SnapshotReader(const std::vector<Uint8>& buffer) : mData(buffer.data()), mSize(buffer.size()) {}
+
+    template<typename T> T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read from a snapshot");
+        require(sizeof(T));
+        T value;
+        std::memcpy(&value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return value;
+    }
+
+    template<typename T> void read(T& value) { value = read<T>(); }
+
+    void readBytes(void* data, std::size_t size) {
+        require(size);
+        if (size) std::memcpy(data, mData + mOffset, size);
+        mOffset += size;
+    }
+
+    void skip(std::size_t size) {
+        require(size);
+        mOffset += size;
+    }
+
+    std::size_t offset() const { return mOffset; }
+    void seek(std::size_t offset) { mOffset = offset; }
+    bool atEnd() const { return mOffset == mSize; }
+
+private:
+    void require(std::size_t size) const {
+        if (mOffset + size > mSize) {
+            throw std::runtime_error("Snapshot data is truncated.");
+        }
+    }
+
+    const Uint8* mData;
+    std::size_t mSize;
+    std::size_t mOffset{0};
+};
+
+// Delta encoding of a snapshot against a previous one.
+//
+// The encoding is a varint with the new size, followed by (skip, length,
+// bytes...) runs: `skip` bytes are taken unchanged from the previous
+// snapshot, then `length` literal bytes follow. Successive snapshots of a
+// running game differ mostly in positions and timers, so the unchanged
+// runs dominate.
+namespace SnapshotDelta {
+    namespace Internal {
+        // Unchanged runs shorter than this stay inside the literal, since
+        // splitting them would cost more in run headers than it saves.
+        const std::size_t kMinSkip = 4;
+
+        inline void putVarint(std::vector<Uint8>& out, std::size_t value) {
+            while (value >= 0x80) {
+                out.push_back(Uint8(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(Uint8(value));
+        }
+
+        // Number of equal bytes in a and b starting at `from`, compared a
+        // word at a time.
+        inline std::size_t matchLength(const Uint8* a, const Uint8* b, std::size_t from, std::size_t end) {
+            std::size_t i = from;
+            while (i + 8 <= end) {
+                Uint64 wa, wb;
+                std::memcpy(&wa, a + i, 8);
+                std::memcpy(&wb, b + i, 8);
+                if (wa != wb) break;
+                i += 8;
+            }
+            while (i < end && a[i] == b[i]) ++i;
+            return i - from;
+        }
+
+        inline std::size_t getVarint(const Uint8*& in, const Uint8* end) {
+            std::size_t value = 0;
+            int shift = 0;
+            while (true) {
+                if (in == end || shift > 56) {
+                    throw std::runtime_error("Snapshot delta is corrupt.");
+                }
+                Uint8 byte = *in++;
+                value |= std::size_t(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) return value;
+                shift += 7;
+            }
+        }
+    }
+
+    inline void encode(const std::vector<Uint8>& previous, const std::vector<Uint8>& current, std::vector<Uint8>& delta) {
+        using namespace Internal;
+
+        delta.clear();
+        putVarint(delta, current.size());
+
+        const std::size_t common = std::min(previous.size(), current.size());
+        std::size_t i = 0;
+
+        while (i < current.size()) {
+            // Unchanged prefix
+            std::size_t skip = i < common ? matchLength(previous.data(), current.data(), i, common) : 0;
+            i += skip;
+
+            // Literal run, extended over unchanged gaps too short to split on
+            std::size_t literalStart = i;
+            while (i < current.size()) {
+                if (i < common && previous[i] == current[i]) {
+                    std::size_t gap = i;
+                    while (gap < common && previous[gap] == current[gap] && gap - i < kMinSkip) ++gap;
+                    if (gap - i >= kMinSkip || gap == current.size()) break;
+                    i = gap;
+                } else {
+                    ++i;
+                }
+            }
+
+            putVarint(delta, skip);
+            putVarint(delta, i - literalStart);
+            delta.insert(delta.end(), current.begin() + literalStart, current.begin() + i);
+        }
+    }
+
+    inline void decode(const std::vector<Uint8>& previous, const std::vector<Uint8>& delta, std::vector<Uint8>& current) {
+        using namespace Internal;
+
+        const Uint8* in = delta.data();
+        const Uint8* end = in + delta.size();
+
+        std::size_t size = getVarint(in, end);
+        current.resize(size);
+
+        std::size_t out = 0;
+        while (in != end) {
+            std::size_t skip = getVarint(in, end);
+            std::size_t length = getVarint(in, end);
+            if (out + skip > std::min(size, previous.size()) || out + skip + length > size
+                || std::size_t(end - in) < length) {
+                throw std::runtime_error("Snapshot delta is corrupt.");
+            }
+
+            if (skip) std::memcpy(&current[out], &previous[out], skip);
+            out += skip;
+            if (length) std::memcpy(&current[out], in, length);
+            out += length;
+            in += length;
+        }
+
+        if (out != size) {
+            throw std::runtime_error("Snapshot delta is corrupt.");
+        }
+    }
+}
+
+// A checkpoint file holds a full snapshot followed by deltas, each against
+// the snapshot before it:
+//   "BHCK", then records of: kind (u8, 0 = full, 1 = delta), size (u32), bytes
+class CheckpointWriter {
+public:
+    CheckpointWriter(const std::string& filename)
+    : mFile(filename.c_str(), std::ios::binary | std::ios::trunc)
+    {
+        if (!mFile) {
+            std::ostringstream oss;
+            oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+            oss << "Unable to open checkpoint file for writing (" << filename << ")";
+            throw std::runtime_error(oss.str());
+        }
+        mFile.write("BHCK", 4);
+    }
+
+    void write(const std::vector<Uint8>& snapshot) {
+        Uint8 kind = 0;
+        const std::vector<Uint8>* record = &snapshot;
+
+        if (!mPrevious.empty()) {
+            SnapshotDelta::encode(mPrevious, snapshot, mDelta);
+            kind = 1;
+            record = &mDelta;
+        }
+
+        Uint32 size = static_cast<Uint32>(record->size());
+        mFile.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+        mFile.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        mFile.write(reinterpret_cast<const char*>(record->data()), size);
+        mFile.flush();
+
+        mPrevious = snapshot;
+    }
+
+private:
+    std::ofstream mFile;
+    std::vector<Uint8> mPrevious;
+    std::vector<Uint8> mDelta;
+};
+
+// Reconstructs the most recent snapshot stored in a checkpoint file.
+inline std::vector<Uint8> loadLatestCheckpoint(const std::string& filename) {
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    char magic[4];
+    if (!file || !file.read(magic, 4) || std::memcmp(magic, "BHCK", 4) != 0) {
+        std::ostringstream oss;
+        oss << "(" << __FILE__ << ":" << __LINE__ << "): ";
+        oss << "Not a valid checkpoint file (" << filename << ")";
+        throw std::runtime_error(oss.str());
+    }
+
+    std::vector<Uint8> snapshot, record, next;
+    Uint8 kind;
+    Uint32 size;
+    while (file.read(reinterpret_cast<char*>(&kind), sizeof(kind))
+           && file.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+        record.resize(size);
+        if (!file.read(reinterpret_cast<char*>(record.data()), size)) {
+            break; // A partially written trailing record is ignored.
+        }
+
+        if (kind == 0) {
+            snapshot.swap(record);
+        } else {
+            SnapshotDelta::decode(snapshot, record, next);
+            snapshot.swap(next);
+        }
+    }
+
+    if (snapshot.empty()) {
+        throw std::runtime_error("Checkpoint file contains no snapshot.");
+    }
+    return snapshot;
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <SDL2/SDL.h>
 
 #include "spritesheet.h"
+#include "rotationcache.h"
 #include <memory>
 
 // This is a handle to a subimage of a sprite sheet
@@ -23,12 +24,32 @@ public:
     }
     
     void draw (int x, int y, int w, int h, double angle) const {
+        if (mRotations && mRotations->fits(w, h)) {
+            mRotations->draw(x, y, angle);
+            return;
+        }
         mSpriteSheet.draw(mSubimageRect, {x,y,w,h}, angle, NULL);
     }
     
+    const SpriteSheet& spriteSheet() const {
+        return mSpriteSheet;
+    }
+    
+    const SDL_Rect& subimageRect() const {
+        return mSubimageRect;
+    }
+    
+    // Pre-renders the sprite at `steps` angles for draws of size w x h;
+    // rotated draws of that size then copy the nearest one. Copies of the
+    // sprite share the cache.
+    void cacheRotations (int w, int h, int steps) {
+        mRotations = std::make_shared<const RotationCache>(mSpriteSheet, mSubimageRect, w, h, steps);
+    }
+    
 private:
     SpriteSheet mSpriteSheet;
     SDL_Rect mSubimageRect;
+    std::shared_ptr<const RotationCache> mRotations;
 };
 
 #endif
@@ -43,6 +43,14 @@ public:
         return mFramePixelHeight;
     }
     
+    const SDL_Rect& frameRect(int frame) const {
+        return mRects[frame];
+    }
+    
+    const SpriteSheet& spriteSheet() const {
+        return *mSpriteSheet;
+    }
+    
 protected:
     
 private:
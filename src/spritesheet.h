@@ -6,6 +6,7 @@
 #include <string>
 
 //#include "sprite.h"
+#include "renderstats.h"
 #include "texture.h"
 
 class Sprite;
@@ -16,7 +17,7 @@ public:
     
     // Called by Renderer
     SpriteSheet (SDL_Renderer* renderer, const std::string& filename)
-    : mTexture(renderer, filename), mRenderer(renderer)
+    : mTexture(renderer, filename), mRenderer(renderer), mFilename(filename)
     {
         SDL_QueryTexture(mTexture.getSDLTexture(), NULL, NULL, &mWidth, &mHeight);
     }
@@ -32,11 +33,13 @@ public:
     void draw (const SDL_Rect& src, const SDL_Rect& dest) const
     {
         SDL_RenderCopy (mRenderer, mTexture.getSDLTexture(), &src, &dest);
+        RenderStats::countDrawCall();
     }
     
     void draw (const SDL_Rect& src, const SDL_Rect& dest, const double angle, const SDL_Point* center) const
     {
         SDL_RenderCopyEx (mRenderer, mTexture.getSDLTexture(), &src, &dest, angle, center, SDL_FLIP_NONE );
+        RenderStats::countDrawCall();
     }
     
     int width() const {
@@ -47,6 +50,18 @@ public:
         return mHeight;
     }
     
+    SDL_Texture* getSDLTexture() const {
+        return mTexture.getSDLTexture();
+    }
+    
+    SDL_Renderer* getRenderer() const {
+        return mRenderer;
+    }
+    
+    const std::string& filename() const {
+        return mFilename;
+    }
+    
 protected:
 
     
@@ -54,6 +69,7 @@ private:
     Texture mTexture;
     int mWidth, mHeight;
     SDL_Renderer* mRenderer;
+    std::string mFilename;
 };
 
 #endif
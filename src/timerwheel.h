@@ -0,0 +1,214 @@
+#ifndef BlackHole_timerwheel_h
+#define BlackHole_timerwheel_h
+
+#include <SDL2/SDL.h>
+#include <cstddef>
+#include <vector>
+
+// Timers keyed by simulation tick, each carrying a payload that is handed
+// back when it expires.
+//
+// The timers sit in a hierarchical timing wheel: four wheels of 256 slots,
+// one per byte of the tick. A timer goes into the wheel of the highest byte
+// in which its tick differs from the current one, in the slot of that
+// byte, so the lowest wheel holds the timers due in the current 256 ticks,
+// one slot per tick. Advancing fires the lowest wheel's slot for the new
+// tick; when a byte rolls over, the next slot of the wheel above is emptied
+// into the wheels below, so every timer reaches the lowest wheel before it
+// is due. A tick with nothing due costs one look at an empty slot, however
+// many timers are waiting.
+//
+// Slots are intrusive doubly linked lists through a pool of records, so
+// scheduling and cancelling are O(1), and records are recycled: a steady
+// number of timers does not allocate.
+template<typename T> class TimerWheel {
+public:
+    // Refers to a scheduled timer. A handle stays safe to use once its
+    // timer has fired or was cancelled; it then refers to nothing.
+    class Handle {
+    public:
+        Handle() = default;
+
+    private:
+        friend class TimerWheel;
+
+        Handle(Uint32 index, Uint32 generation) : mIndex(index), mGeneration(generation) { }
+
+        Uint32 mIndex{0};
+        Uint32 mGeneration{0};
+    };
+
+    // `now` is the last tick advanced to: its timers count as fired.
+    explicit TimerWheel(Uint32 now = 0)
+    : mNow(now)
+    {
+        for (auto& head : mHeads) head = kNone;
+    }
+
+    Uint32 now() const { return mNow; }
+
+    // Timers waiting to fire.
+    std::size_t size() const { return mCount; }
+
+    // Makes room for `count` timers, so scheduling does not allocate until
+    // there are more.
+    void reserve(std::size_t count) { mNodes.reserve(count); }
+
+    // Fires `payload` when the wheel advances to `tick`. A tick that is
+    // not after now fires on the next advance. Ticks are compared with
+    // wrap-around, so `tick` must be less than 2^31 ticks away.
+    Handle schedule(Uint32 tick, const T& payload) {
+        if (static_cast<Sint32>(tick - mNow) <= 0) tick = mNow + 1;
+
+        Uint32 i = acquire();
+        Node& node(mNodes[i]);
+        node.payload = payload;
+        node.tick = tick;
+        link(i, listFor(tick));
+        return Handle(i, node.generation);
+    }
+
+    // Returns whether the timer was still waiting.
+    bool cancel(Handle handle) {
+        if (!pending(handle)) return false;
+
+        unlink(handle.mIndex);
+        release(handle.mIndex);
+        return true;
+    }
+
+    bool pending(Handle handle) const {
+        // A default handle is never pending, and checking one reads nothing.
+        return handle.mGeneration != 0 && handle.mIndex < mNodes.size()
+            && mNodes[handle.mIndex].generation == handle.mGeneration
+            && mNodes[handle.mIndex].list != kNone;
+    }
+
+    // Advances tick by tick up to `tick`, calling `fire(payload)` for each
+    // timer that expires. Timers due on the same tick fire in no particular
+    // order. `fire` may schedule and cancel timers.
+    template<typename TFire> void advance(Uint32 tick, TFire&& fire) {
+        while (static_cast<Sint32>(tick - mNow) > 0) {
+            ++mNow;
+
+            // Top down, so a timer can drop through several wheels at once.
+            for (int level = kLevels - 1; level > 0; --level) {
+                if ((mNow & ((1u << (kSlotBits * level)) - 1)) == 0) {
+                    cascade(level * kSlots + ((mNow >> (kSlotBits * level)) & kSlotMask));
+                }
+            }
+
+            Uint32 list = mNow & kSlotMask;
+            while (mHeads[list] != kNone) {
+                Uint32 i = mHeads[list];
+                unlink(i);
+                T payload(mNodes[i].payload);
+                release(i);
+                fire(payload);
+            }
+        }
+    }
+
+    // Drops every timer and makes `now` the current tick. Handles to the
+    // dropped timers refer to nothing from then on.
+    void reset(Uint32 now) {
+        mFree = kNone;
+        for (Uint32 i = static_cast<Uint32>(mNodes.size()); i-- > 0;) {
+            if (mNodes[i].list != kNone) {
+                mNodes[i].list = kNone;
+                nextGeneration(mNodes[i]);
+            }
+            mNodes[i].next = mFree;
+            mFree = i;
+        }
+        for (auto& head : mHeads) head = kNone;
+        mCount = 0;
+        mNow = now;
+    }
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 8;
+    static constexpr Uint32 kSlots = 1u << kSlotBits;
+    static constexpr Uint32 kSlotMask = kSlots - 1;
+    static constexpr Uint32 kNone = 0xFFFFFFFF;
+
+    struct Node {
+        T payload{};
+        Uint32 tick{0};
+        Uint32 generation{1};
+        Uint32 list{kNone};     // the slot it is in; kNone while free
+        Uint32 prev{kNone}, next{kNone};
+    };
+
+    // The slot for a timer due on `tick`, relative to now.
+    Uint32 listFor(Uint32 tick) const {
+        for (int level = 0; level < kLevels - 1; ++level) {
+            int shift = kSlotBits * (level + 1);
+            if ((tick >> shift) == (mNow >> shift)) {
+                return level * kSlots + ((tick >> (kSlotBits * level)) & kSlotMask);
+            }
+        }
+        return (kLevels - 1) * kSlots + (tick >> (kSlotBits * (kLevels - 1)));
+    }
+
+    // Moves the timers of a slot to where they belong now.
+    void cascade(Uint32 list) {
+        Uint32 i = mHeads[list];
+        mHeads[list] = kNone;
+        while (i != kNone) {
+            Uint32 next = mNodes[i].next;
+            link(i, listFor(mNodes[i].tick));
+            i = next;
+        }
+    }
+
+    void link(Uint32 i, Uint32 list) {
+        Node& node(mNodes[i]);
+        node.list = list;
+        node.prev = kNone;
+        node.next = mHeads[list];
+        if (node.next != kNone) mNodes[node.next].prev = i;
+        mHeads[list] = i;
+    }
+
+    void unlink(Uint32 i) {
+        Node& node(mNodes[i]);
+        if (node.prev != kNone) mNodes[node.prev].next = node.next;
+        else mHeads[node.list] = node.next;
+        if (node.next != kNone) mNodes[node.next].prev = node.prev;
+    }
+
+    Uint32 acquire() {
+        ++mCount;
+        if (mFree == kNone) {
+            mNodes.emplace_back();
+            return static_cast<Uint32>(mNodes.size() - 1);
+        }
+        Uint32 i = mFree;
+        mFree = mNodes[i].next;
+        return i;
+    }
+
+    void release(Uint32 i) {
+        Node& node(mNodes[i]);
+        node.list = kNone;
+        nextGeneration(node);
+        node.next = mFree;
+        mFree = i;
+        --mCount;
+    }
+
+    // Generation 0 is never used, so a default Handle refers to nothing.
+    static void nextGeneration(Node& node) {
+        if (++node.generation == 0) node.generation = 1;
+    }
+
+    std::vector<Node> mNodes;
+    Uint32 mFree{kNone};
+    Uint32 mHeads[kLevels * kSlots];
+    Uint32 mNow;
+    std::size_t mCount{0};
+};
+
+#endif
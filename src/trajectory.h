@@ -0,0 +1,252 @@
+#ifndef BlackHole_trajectory_h
+#define BlackHole_trajectory_h
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "kinematics.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// What a torpedo flies through: the pull of the attractor (attraction / d²
+// toward it), the box its center must stay in, and how it moves each tick.
+struct TrajectoryWorld {
+    float attractorX, attractorY;
+    float attraction;
+    float minX, minY, maxX, maxY;
+    float tickSeconds;
+    float speed;
+    int maxSteps;
+};
+
+// Something the preview stops at: a box, already grown by the torpedo's
+// half size, that its center cannot enter.
+struct TrajectoryObstacle {
+    float left, top, right, bottom;
+};
+
+// Usage counters of a trajectory preview.
+struct TrajectoryStats {
+    Uint32 requests{0};         // frames that showed the preview
+    Uint32 computes{0};         // ... that had to integrate new paths
+    double seconds{0.0};        // time spent integrating
+    double worstSeconds{0.0};
+};
+
+// The path a torpedo fired now would take, for drawing as a preview.
+//
+// Paths are integrated tick by tick with the same float operations, in the
+// same order, as the game's gravity pass and KinematicsBatch's exact
+// integration, so without obstacles the preview is where the torpedo
+// goes. Four headings are integrated at once, one per SIMD lane: the one
+// asked for and others a lane spacing either side of it. A heading within
+// half a spacing of a cached lane reuses that lane's path, so a ship that
+// turns steadily only needs new paths every few spacings.
+class TrajectoryPreview {
+public:
+    static constexpr int kLanes = 4;
+
+    TrajectoryPreview(const TrajectoryWorld& world, float laneSpacing)
+    : mWorld(world), mSpacing(laneSpacing),
+    mX(kLanes * world.maxSteps), mY(kLanes * world.maxSteps)
+    {
+    }
+
+    // Whether a cached path starts at (x, y) with a heading close enough
+    // to `heading` (in degrees, 0 up); if so, it becomes the current one.
+    bool covers(float x, float y, float heading) {
+        ++mStats.requests;
+        if (!mValid || x != mStartX || y != mStartY) return false;
+
+        float best = mSpacing / 2.0f;
+        int lane = -1;
+        for (int i = 0; i < kLanes; ++i) {
+            float error = std::fabs(angleBetween(heading, mHeadings[i]));
+            if (error <= best) {
+                best = error;
+                lane = i;
+            }
+        }
+        if (lane < 0) return false;
+
+        mLane = lane;
+        return true;
+    }
+
+    // Integrates new paths around `heading` from (x, y), each ending at the
+    // bounds or the first obstacle it reaches.
+    void compute(float x, float y, float heading, const std::vector<TrajectoryObstacle>& obstacles) {
+        auto start(std::chrono::high_resolution_clock::now());
+
+        mStartX = x;
+        mStartY = y;
+        for (int i = 0; i < kLanes; ++i) {
+            mHeadings[i] = Kinematics::wrapDegrees(heading + (i - 1) * mSpacing);
+        }
+        integrate();
+        for (int i = 0; i < kLanes; ++i) clip(i, obstacles);
+
+        mLane = 1;
+        mValid = true;
+
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        ++mStats.computes;
+        mStats.seconds += seconds;
+        mStats.worstSeconds = std::max(mStats.worstSeconds, seconds);
+    }
+
+    // Forgets the paths, e.g. when what they pass has changed.
+    void invalidate() { mValid = false; }
+
+    // The current path: the torpedo's position after each tick.
+    int size() const { return mLength[mLane]; }
+    float x(int step) const { return mX[step * kLanes + mLane]; }
+    float y(int step) const { return mY[step * kLanes + mLane]; }
+
+    // Whether the current path ends at an obstacle rather than the bounds
+    // (or the step limit).
+    bool hits() const { return mHits[mLane]; }
+
+    const TrajectoryStats& stats() const { return mStats; }
+
+private:
+    // `a - b` in (-180, 180].
+    static float angleBetween(float a, float b) {
+        float d = a - b;
+        return d - 360.0f * std::ceil((d - 180.0f) / 360.0f);
+    }
+
+    // The same operations as Game::simulateTick's gravity pass, followed by
+    // KinematicsBatch::integrateExact, for each tick of flight. Lanes that
+    // leave the bounds stop growing; the loop ends when all have.
+    void integrate() {
+        const TrajectoryWorld& w(mWorld);
+        float x[kLanes], y[kLanes], vx[kLanes], vy[kLanes];
+        for (int i = 0; i < kLanes; ++i) {
+            // As Game::createPhotonTorpedo sets the velocity.
+            float angleRad = mHeadings[i] * (M_PI / 180.0);
+            x[i] = mStartX;
+            y[i] = mStartY;
+            vx[i] = std::sin(angleRad) * w.speed;
+            vy[i] = -std::cos(angleRad) * w.speed;
+            mSpeed[i] = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+            mLength[i] = w.maxSteps;
+            mHits[i] = false;
+        }
+
+        int active = kLanes;
+        int step = 0;
+#if defined(__SSE2__)
+        const __m128 ax = _mm_set1_ps(w.attractorX);
+        const __m128 ay = _mm_set1_ps(w.attractorY);
+        const __m128 attraction = _mm_set1_ps(w.attraction);
+        const __m128 dt = _mm_set1_ps(w.tickSeconds);
+        const __m128 speed = _mm_loadu_ps(mSpeed);
+        __m128 px = _mm_loadu_ps(x), py = _mm_loadu_ps(y);
+        __m128 pvx = _mm_loadu_ps(vx), pvy = _mm_loadu_ps(vy);
+
+        for (; step < w.maxSteps && active > 0; ++step) {
+            __m128 dx = _mm_sub_ps(ax, px);
+            __m128 dy = _mm_sub_ps(ay, py);
+            __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+            __m128 s = _mm_div_ps(attraction, _mm_mul_ps(d, d));
+            pvx = _mm_add_ps(pvx, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(dx, d), s), dt));
+            pvy = _mm_add_ps(pvy, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(dy, d), s), dt));
+
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(pvx, pvx), _mm_mul_ps(pvy, pvy)));
+            pvx = _mm_mul_ps(_mm_div_ps(pvx, length), speed);
+            pvy = _mm_mul_ps(_mm_div_ps(pvy, length), speed);
+            px = _mm_add_ps(px, _mm_mul_ps(pvx, dt));
+            py = _mm_add_ps(py, _mm_mul_ps(pvy, dt));
+
+            _mm_storeu_ps(&mX[step * kLanes], px);
+            _mm_storeu_ps(&mY[step * kLanes], py);
+            active = endOutOfBounds(step);
+        }
+#else
+        for (; step < w.maxSteps && active > 0; ++step) {
+            for (int i = 0; i < kLanes; ++i) {
+                float dx = w.attractorX - x[i];
+                float dy = w.attractorY - y[i];
+                float d = std::sqrt(dx * dx + dy * dy);
+                float s = w.attraction / (d * d);
+                vx[i] += dx / d * s * w.tickSeconds;
+                vy[i] += dy / d * s * w.tickSeconds;
+
+                float length = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+                vx[i] = vx[i] / length * mSpeed[i];
+                vy[i] = vy[i] / length * mSpeed[i];
+                x[i] += vx[i] * w.tickSeconds;
+                y[i] += vy[i] * w.tickSeconds;
+
+                mX[step * kLanes + i] = x[i];
+                mY[step * kLanes + i] = y[i];
+            }
+            active = endOutOfBounds(step);
+        }
+#endif
+    }
+
+    // Ends the lanes whose position after `step` is out of bounds, and
+    // returns how many are still going.
+    int endOutOfBounds(int step) {
+        int active = 0;
+        for (int i = 0; i < kLanes; ++i) {
+            if (mLength[i] <= step) continue;
+
+            float x = mX[step * kLanes + i], y = mY[step * kLanes + i];
+            if (x < mWorld.minX || x > mWorld.maxX || y < mWorld.minY || y > mWorld.maxY) mLength[i] = step + 1;
+            else ++active;
+        }
+        return active;
+    }
+
+    // Cuts a lane's path at the first step inside an obstacle. Only the
+    // obstacles that overlap the path's bounding box are tested, and each
+    // only up to the earliest hit found so far.
+    void clip(int lane, const std::vector<TrajectoryObstacle>& obstacles) {
+        float left = mStartX, right = mStartX, top = mStartY, bottom = mStartY;
+        for (int step = 0; step < mLength[lane]; ++step) {
+            left = std::min(left, mX[step * kLanes + lane]);
+            right = std::max(right, mX[step * kLanes + lane]);
+            top = std::min(top, mY[step * kLanes + lane]);
+            bottom = std::max(bottom, mY[step * kLanes + lane]);
+        }
+
+        for (const TrajectoryObstacle& o : obstacles) {
+            if (o.right < left || o.left > right || o.bottom < top || o.top > bottom) continue;
+
+            for (int step = 0; step < mLength[lane]; ++step) {
+                float x = mX[step * kLanes + lane], y = mY[step * kLanes + lane];
+                if (x >= o.left && x <= o.right && y >= o.top && y <= o.bottom) {
+                    mLength[lane] = step + 1;
+                    mHits[lane] = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    TrajectoryWorld mWorld;
+    float mSpacing;
+
+    bool mValid{false};
+    int mLane{1};
+    float mStartX{0.0f}, mStartY{0.0f};
+    float mHeadings[kLanes];
+    float mSpeed[kLanes];
+    int mLength[kLanes];
+    bool mHits[kLanes];
+
+    // Step-major: the kLanes positions after tick 0, then after tick 1, ...
+    std::vector<float> mX, mY;
+
+    TrajectoryStats mStats;
+};
+
+#endif